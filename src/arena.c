@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16UL
+
+
+static ArenaChunk* create_chunk(size_t capacity) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + capacity);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    return chunk;
+}
+
+
+int create_arena(Arena *arena, size_t chunk_size) {
+    if (chunk_size == 0) {
+        return -1;
+    }
+    arena->chunk_size = chunk_size;
+    arena->bytes_used = 0;
+    arena->head = create_chunk(chunk_size);
+    if (arena->head == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+
+void free_arena(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->bytes_used = 0;
+}
+
+
+void reset_arena(Arena *arena) {
+    // Chunks grow geometrically, so the head is always the largest one
+    ArenaChunk *chunk = arena->head != NULL ? arena->head->next : NULL;
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    if (arena->head != NULL) {
+        arena->head->next = NULL;
+        arena->head->used = 0;
+    }
+    arena->bytes_used = 0;
+}
+
+
+static size_t get_padding(const ArenaChunk *chunk) {
+    uintptr_t address = (uintptr_t) (chunk->data + chunk->used);
+    return (ARENA_ALIGNMENT - address % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+}
+
+
+void* arena_alloc(Arena *arena, size_t size) {
+    ArenaChunk *chunk = arena->head;
+
+    if (chunk == NULL || chunk->capacity - chunk->used < size + get_padding(chunk)) {
+        size_t capacity = chunk != NULL ? chunk->capacity * 2 : arena->chunk_size;
+        while (capacity < size + ARENA_ALIGNMENT) {
+            capacity *= 2;
+        }
+        ArenaChunk *new_chunk = create_chunk(capacity);
+        if (new_chunk == NULL) {
+            return NULL;
+        }
+        new_chunk->next = chunk;
+        arena->head = new_chunk;
+        chunk = new_chunk;
+    }
+
+    chunk->used += get_padding(chunk);
+    void *result = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->bytes_used += size;
+    return result;
+}
+
+
+void* arena_calloc(Arena *arena, size_t amount, size_t size) {
+    if (size != 0 && amount > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *result = arena_alloc(arena, amount * size);
+    if (result != NULL) {
+        memset(result, 0, amount * size);
+    }
+    return result;
+}
+
+
+char* arena_copy_string(Arena *arena, const char *s, size_t length) {
+    char *copy = arena_alloc(arena, length + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+
+size_t arena_bytes_used(const Arena *arena) {
+    return arena->bytes_used;
+}
@@ -0,0 +1,45 @@
+#ifndef G1_ARENA_H
+#define G1_ARENA_H
+
+
+#include <stdlib.h>
+
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t capacity, used;
+    unsigned char data[];
+} ArenaChunk;
+
+
+// Bump allocator. Everything allocated from an arena is released together by
+// `reset_arena` or `free_arena`, so individual allocations are never freed.
+typedef struct {
+    ArenaChunk *head;
+    size_t chunk_size, bytes_used;
+} Arena;
+
+
+// Create a new arena whose first chunk holds `chunk_size` bytes.
+int create_arena(Arena *arena, size_t chunk_size);
+
+// Free every chunk owned by `arena`.
+void free_arena(Arena *arena);
+
+// Release all allocations but keep the largest chunk for the next run.
+void reset_arena(Arena *arena);
+
+// Returns `size` bytes of uninitialized memory aligned for any type, or NULL.
+void* arena_alloc(Arena *arena, size_t size);
+
+// Returns zeroed memory for `amount` elements of `size` bytes, or NULL.
+void* arena_calloc(Arena *arena, size_t amount, size_t size);
+
+// Returns a null terminated copy of the first `length` characters of `s`.
+char* arena_copy_string(Arena *arena, const char *s, size_t length);
+
+// Returns the amount of bytes handed out since the arena was created or last reset.
+size_t arena_bytes_used(const Arena *arena);
+
+
+#endif
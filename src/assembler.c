@@ -1,20 +1,31 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "lexer.h"
-#include "list.h"
-#include "map.h"
 #include "util.h"
+#include "arena.h"
+#include "image.h"
+#include "instruction.h"
+#include "object.h"
+#include "optimize.h"
+#include "sourcemap.h"
+#include "variables.h"
+#include "verify.h"
+#include "assembler.h"
 
-#define AMOUNT_META_VARS 4
-#define AMOUNT_INSTRUCTIONS 17
+#define INITAL_LABEL_CAPACITY 32UL
+#define INITIAL_INSTRUCTION_CAPACITY 256UL
+#define ARENA_CHUNK_SIZE 4096UL
 
-#define DEFAULT_MEMORY 128
-#define DEFAULT_WIDTH 100
-#define DEFAULT_HEIGHT 100
-#define DEFAULT_TICKRATE 60
+#define MIN_INSTRUCTIONS_PER_THREAD 16384UL
+#define MAX_ENCODE_THREADS 64UL
 
-#define INITAL_LABEL_CAPACITY 32UL
+#define STDIN_NAME "<stdin>"
+#define VARIABLE_META_VAR "var"
 
 
 typedef enum {
@@ -23,226 +34,541 @@ typedef enum {
 } AssemblerState;
 
 
+// The file being assembled. Tokens point into `text`, and `lines` gives their line and column.
 typedef struct {
-    uint8_t opcode;
-    Token arguments[4];
-} Instruction;
+    const char *name;
+    const char *text;
+    LineIndex lines;
+} SourceFile;
 
 
-typedef enum {
-    LITERAL_ARG,
-    ADDRESS_ARG
-} ArgumentType;
+void error(uint32_t offset, SourceFile *file, const char *message) {
+    uint32_t line, column;
+    get_source_location(&line, &column, &file->lines, offset);
+    fprintf(stderr, "\x1b[31mERROR (%s:%u:%u): %s\n", file->name, line+1, column+1, message);
+}
 
 
-typedef struct {
-    ArgumentType type;
-    int32_t value;
-} Argument;
+void token_error(const Token *token, SourceFile *file, const char *message) {
+    error(token->offset, file, message);
+}
 
 
-const char *META_VARIABLES[AMOUNT_META_VARS] = {
-    "memory",
-    "width",
-    "height",
-    "tickrate"
-};
+void token_warning(const Token *token, SourceFile *file, const char *message) {
+    uint32_t line, column;
+    get_source_location(&line, &column, &file->lines, token->offset);
+    fprintf(stderr, "\x1b[33mWARNING (%s:%u:%u): %s\n", file->name, line+1, column+1, message);
+}
 
 
-const char *INSTRUCTIONS[AMOUNT_INSTRUCTIONS] = {
-    "mov", "movp",
-    "add", "sub", "mul", "div", "mod",
-    "less", "equal", "not",
-    "jmp", 
-    "color", "point", "line", "rect",
-    "log", "getp"
-};
+int get_instruction_args(Token *arg_dest, uint8_t arg_count, Lexer *lexer, const LabelMap *variables, SourceFile *file) {
+    for (uint8_t i = 0; i < arg_count; i++) {
+        Token token;
+        int next_response = lexer_next(lexer, &token);
+        if (next_response != 0) {
+            error(get_lexer_offset(lexer), file, "Expected instruction argument.");
+            return -1;
+        }
+        if (token.type != INTEGER && token.type != ADDRESS && token.type != NAME) {
+            token_error(&token, file, "Expected integer, address, or name for instruction argument.");
+            return -1;
+        }
+        if (is_variable_token(file->text, &token) && get_label_map_value(NULL, variables, get_token_text(file->text, &token) + 1, token.length - 1) != 0) {
+            token_error(&token, file, "Tried to reference undeclared variable.");
+            return -1;
+        }
+        arg_dest[i] = token;
+    }
+    return 0;
+}
 
-const uint8_t ARGUMENT_COUNTS[AMOUNT_INSTRUCTIONS] = {2, 2, 3, 3, 3, 3, 3, 3, 3, 2, 2, 3, 2, 4, 4, 1, 3};
+
+// Resolve `token` into `arg_dest` without reporting errors. Labels found in `symbols->imports`
+// resolve to their import index so they can be patched by the linker.
+// Returns -1 for an undefined label, -2 for an invalid argument type and -3 for an undeclared variable.
+int resolve_argument(Argument *arg_dest, const Token *token, const SymbolTables *symbols) {
+    const char *token_value = get_token_text(symbols->source, token);
+    arg_dest->reference = NO_REFERENCE;
+    switch (token->type) {
+        case INTEGER:
+            arg_dest->type = LITERAL_ARG;
+            arg_dest->value = (int32_t) strtol(token_value, NULL, 10);
+            return 0;
+        case NAME:
+            arg_dest->type = LITERAL_ARG;
+            if (get_label_map_value(&arg_dest->value, symbols->labels, token_value, token->length) == 0) {
+                arg_dest->reference = LABEL_REFERENCE;
+                return 0;
+            }
+            if (symbols->imports != NULL && get_label_map_value(&arg_dest->value, symbols->imports, token_value, token->length) == 0) {
+                arg_dest->reference = IMPORT_REFERENCE;
+                return 0;
+            }
+            return -1;
+        case ADDRESS:
+            arg_dest->type = ADDRESS_ARG;
+            if (is_variable_token(symbols->source, token)) {
+                if (symbols->variables == NULL || get_label_map_value(&arg_dest->value, symbols->variables, token_value+1, token->length-1) != 0) {
+                    return -3;
+                }
+                return 0;
+            }
+            arg_dest->value = (int32_t) strtol(token_value+1, NULL, 10);  // Add 1 to cut off '$'
+            return 0;
+        default:
+            return -2;
+    }
+}
 
 
-void error(uint64_t line, uint64_t column, const char *source_file, const char *message) {
-    printf("\x1b[31mERROR (%s:%ld:%ld): %s\n", source_file, line, column, message);
+int parse_argument_token(Argument *arg_dest, const Token *token, const SymbolTables *symbols, SourceFile *file) {
+    int error_code = resolve_argument(arg_dest, token, symbols);
+    if (error_code == -1) {
+        token_error(token, file, "Tried to reference undefined label.");
+    }
+    else if (error_code == -2) {
+        token_error(token, file, "Invalid argument type.");
+    }
+    else if (error_code == -3) {
+        token_error(token, file, "Tried to reference undeclared variable.");
+    }
+    return error_code;
 }
 
 
-void token_error(const Token *token, const char *source_file, const char *message) {
-    error(token->source_line+1, token->source_column+1, source_file, message);
+typedef struct {
+    InstructionList *instructions;
+    const SymbolTables *symbols;
+    size_t start, end;
+
+    // Byte offset of instruction `start` in `dest`, and the byte size of the range
+    uint8_t *dest;
+    size_t offset, size;
+
+    // Index of the first instruction that failed to resolve, or SIZE_MAX
+    size_t failed_index;
+} EncodeJob;
+
+
+static void* resolve_instruction_range(void *job_ptr) {
+    EncodeJob *job = job_ptr;
+    for (size_t i = job->start; i < job->end; i++) {
+        Instruction *ins = &job->instructions->data[i];
+        uint8_t arg_count = ARGUMENT_COUNTS[ins->opcode];
+        for (uint8_t j = 0; j < arg_count; j++) {
+            if (resolve_argument(&ins->values[j], &ins->arguments[j], job->symbols) != 0) {
+                job->failed_index = i;
+                return NULL;
+            }
+        }
+        if (validate_instruction(ins->opcode, ins->values) != -1) {
+            job->failed_index = i;
+            return NULL;
+        }
+    }
+    return NULL;
 }
 
 
-int get_meta_var_index(const char *s) {
-    for (int i = 0; i < AMOUNT_META_VARS; i++) {
-        if (strcmp(s, META_VARIABLES[i]) == 0) {
-            return i;
+static void* encode_instruction_range(void *job_ptr) {
+    EncodeJob *job = job_ptr;
+    uint8_t *dest = job->dest + job->offset;
+    for (size_t i = job->start; i < job->end; i++) {
+        const Instruction *ins = &job->instructions->data[i];
+        dest = encode_instruction(dest, ins->opcode, ins->values);
+    }
+    return NULL;
+}
+
+
+// Run `function` on every job, using one thread per job beyond the first.
+static void run_encode_jobs(void *(*function)(void*), EncodeJob *jobs, size_t amount_jobs) {
+    pthread_t threads[MAX_ENCODE_THREADS];
+    bool started[MAX_ENCODE_THREADS] = {false};
+    for (size_t i = 1; i < amount_jobs; i++) {
+        started[i] = pthread_create(&threads[i], NULL, function, &jobs[i]) == 0;
+        if (!started[i]) {
+            function(&jobs[i]);
+        }
+    }
+    function(&jobs[0]);
+    for (size_t i = 1; i < amount_jobs; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
         }
     }
-    return -1;
 }
 
 
-int get_instruction_opcode(const char *s) {
-    for (int i = 0; i < AMOUNT_INSTRUCTIONS; i++) {
-        if (strcmp(s, INSTRUCTIONS[i]) == 0) {
-            return i;
+// Split `instructions` into one job per worker thread and sum each job's byte size. Returns the amount of jobs.
+static size_t create_encode_jobs(EncodeJob *jobs, InstructionList *instructions, const SymbolTables *symbols, size_t requested_threads) {
+    size_t amount_jobs = requested_threads;
+    if (amount_jobs == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        amount_jobs = online > 0 ? (size_t) online : 1;
+    }
+    size_t useful = instructions->size / MIN_INSTRUCTIONS_PER_THREAD;
+    if (amount_jobs > useful) {
+        amount_jobs = useful;
+    }
+    if (amount_jobs > MAX_ENCODE_THREADS) {
+        amount_jobs = MAX_ENCODE_THREADS;
+    }
+    if (amount_jobs == 0) {
+        amount_jobs = 1;
+    }
+
+    size_t per_job = instructions->size / amount_jobs;
+    for (size_t i = 0; i < amount_jobs; i++) {
+        jobs[i].instructions = instructions;
+        jobs[i].symbols = symbols;
+        jobs[i].start = i * per_job;
+        jobs[i].end = i == amount_jobs - 1 ? instructions->size : (i + 1) * per_job;
+        jobs[i].dest = NULL;
+        jobs[i].offset = 0;
+        jobs[i].failed_index = SIZE_MAX;
+
+        // Summing sizes is one table lookup per instruction, so it is not worth a thread round
+        size_t size = 0;
+        for (size_t j = jobs[i].start; j < jobs[i].end; j++) {
+            size += get_instruction_size(instructions->data[j].opcode);
         }
+        jobs[i].size = size;
     }
-    return -1;
+    return amount_jobs;
 }
 
 
-int get_instruction_args(Token *arg_dest, uint8_t arg_count, Lexer *lexer, const char *source_file) {
-    for (uint8_t i = 0; i < arg_count; i++) {
-        Token token;
-        lexer_next(lexer, &token);
-        if (token.type != INTEGER && token.type != ADDRESS && token.type != NAME) {
-            token_error(&token, source_file, "Expected integer, address, or name for instruction argument.");
+// Resolve the argument tokens of every instruction into values, reporting the first failure.
+int resolve_instructions(InstructionList *instructions, const SymbolTables *symbols, SourceFile *file, size_t requested_threads) {
+    EncodeJob jobs[MAX_ENCODE_THREADS];
+    size_t amount_jobs = create_encode_jobs(jobs, instructions, symbols, requested_threads);
+    run_encode_jobs(resolve_instruction_range, jobs, amount_jobs);
+
+    // All jobs are joined, so the first failing argument is reported in order on the calling thread
+    for (size_t i = 0; i < amount_jobs; i++) {
+        if (jobs[i].failed_index != SIZE_MAX) {
+            Instruction *ins = get_instruction_list_value(instructions, jobs[i].failed_index);
+            for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+                if (parse_argument_token(&ins->values[j], &ins->arguments[j], symbols, file) != 0) {
+                    return -1;
+                }
+            }
+            int invalid = validate_instruction(ins->opcode, ins->values);
+            if (invalid != -1) {
+                token_error(&ins->arguments[invalid], file, "Expected an address to store the result in.");
+            }
             return -1;
         }
-        arg_dest[i] = token;
     }
     return 0;
 }
 
 
-int parse_argument_token(Argument *arg_dest, const Token *token, const Map *labels, const char *source_file) {
-    char *token_value = get_token_value(token);
-    int error_code = 0;
-    switch (token->type) {
-        case INTEGER:
-            arg_dest->type = LITERAL_ARG;
-            arg_dest->value = atoi(token_value);
-            break;
-        case NAME:
-            arg_dest->type = LITERAL_ARG;
-            void *index;
-            int label_result = get_map_value(&index, labels, token_value);
-            if (label_result == -1) {
-                token_error(token, source_file, "Tried to reference undefined label.");
-                error_code = -1;
-            }
-            else {
-                arg_dest->value = *(int32_t*) index;
-            }
-            break;
-        case ADDRESS:
-            arg_dest->type = ADDRESS_ARG;
-            arg_dest->value = atoi(token_value+1);  // Add 1 to cut off '$'
-            break;
-        default:
-            token_error(token, source_file, "Invalid argument type.");
-            error_code = -2;
+// Encode every resolved instruction into one buffer from `arena`. Each instruction's size only depends
+// on its opcode, so a prefix sum over the job sizes gives every job its output offset up front.
+uint8_t* encode_instructions(
+        size_t *size_dest, InstructionList *instructions,
+        size_t header_size, size_t trailer_size, size_t requested_threads, Arena *arena
+    ) {
+    EncodeJob jobs[MAX_ENCODE_THREADS];
+    size_t amount_jobs = create_encode_jobs(jobs, instructions, NULL, requested_threads);
+
+    size_t offset = header_size;
+    for (size_t i = 0; i < amount_jobs; i++) {
+        jobs[i].offset = offset;
+        offset += jobs[i].size;
     }
 
-    free(token_value);
-    return error_code;
+    uint8_t *buffer = arena_alloc(arena, offset + trailer_size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < amount_jobs; i++) {
+        jobs[i].dest = buffer;
+    }
+
+    run_encode_jobs(encode_instruction_range, jobs, amount_jobs);
+
+    *size_dest = offset + trailer_size;
+    return buffer;
+}
+
+
+// Check the encoded code against the header and record which checks passed in its flags.
+int verify_output_code(ImageHeader *header, const uint8_t *code, size_t code_size, const InstructionList *instructions, SourceFile *file) {
+    VerifyResult result;
+    if (verify_image_code(&result, code, code_size, header) != 0) {
+        const char *message = get_verify_error_message(result.error);
+        if (result.failed_index < instructions->size) {
+            const Instruction *ins = get_instruction_list_value(instructions, result.failed_index);
+            token_error(&ins->arguments[result.failed_argument], file, message);
+        }
+        else {
+            fprintf(stderr, "\x1b[31mERROR (%s): %s\n", file->name, message);
+        }
+        return -1;
+    }
+
+    warn_unverified(&result, file->name);
+    header->flags = result.flags;
+    return 0;
 }
 
 
 int write_output_file(
-        const char *source_file, const char *output_file, 
-        int32_t meta_vars[AMOUNT_META_VARS], const List *instructions, const Map *labels,
-        int32_t start_label, int32_t tick_label
+        const char *output_file, ImageHeader *header, InstructionList *instructions,
+        SourceFile *file, size_t threads, Arena *arena
     ) {
-    // Clear existing file
-    FILE *clearfile = fopen(output_file, "w");
-    if (clearfile != NULL) {
-        fclose(clearfile);
+    size_t header_size = get_image_header_size(header);
+    size_t image_size;
+    uint8_t *image = encode_instructions(&image_size, instructions, header_size, IMAGE_TRAILER_SIZE, threads, arena);
+    if (image == NULL) {
+        fprintf(stderr, "Failed to allocate output image.\n");
+        return -1;
     }
 
-    FILE *outfile = fopen(output_file, "a");
-    if (outfile == NULL) {
-        return -1;
+    if (header->version >= VERIFIED_IMAGE_VERSION) {
+        size_t code_size = image_size - header_size - IMAGE_TRAILER_SIZE;
+        if (verify_output_code(header, image + header_size, code_size, instructions, file) != 0) {
+            return -2;
+        }
     }
 
-    // Write signature
-    fprintf(outfile, "g1");
+    put_image_header(image, image_size, header);
+    return write_image_file(output_file, image, image_size);
+}
 
-    // Write meta vars
-    write_i32_big(outfile, meta_vars[0]);
-    write_i16_big(outfile, (uint16_t) meta_vars[1]);
-    write_i16_big(outfile, (uint16_t) meta_vars[2]);
-    write_i16_big(outfile, (uint16_t) meta_vars[3]);
 
-    // Write start and tick labels
-    write_i32_big(outfile, tick_label);
-    write_i32_big(outfile, start_label);
+// Collect the labels referenced but not defined in this module.
+int collect_imports(LabelMap *imports, const InstructionList *instructions, const LabelMap *labels, const char *source, Arena *arena) {
+    for (size_t i = 0; i < instructions->size; i++) {
+        const Instruction *ins = get_instruction_list_value(instructions, i);
+        uint8_t arg_count = ARGUMENT_COUNTS[ins->opcode];
+        for (uint8_t j = 0; j < arg_count; j++) {
+            const Token *token = &ins->arguments[j];
+            if (token->type != NAME) {
+                continue;
+            }
 
-    // Write instruction count
-    write_i32_big(outfile, (uint32_t) instructions->size);
+            const char *name = get_token_text(source, token);
+            if (get_label_map_value(NULL, labels, name, token->length) != 0 && get_label_map_value(NULL, imports, name, token->length) != 0) {
+                char *key = arena_copy_string(arena, name, token->length);
+                if (key == NULL || add_label_map_value(imports, key, (int32_t) imports->size) != 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
 
-    // Write instructions
-    bool got_error = false;
+
+// Add a relocation for every label argument. Import arguments are cleared to 0 for the linker.
+int collect_relocations(RelocationList *relocations, InstructionList *instructions) {
+    uint32_t offset = 0;
     for (size_t i = 0; i < instructions->size; i++) {
-        Instruction *ins = get_list_value(instructions, i);
-        
-        // Write opcode
-        fwrite(&ins->opcode, sizeof(uint8_t), 1, outfile);
-        
-        // Write arguments
+        Instruction *ins = get_instruction_list_value(instructions, i);
         uint8_t arg_count = ARGUMENT_COUNTS[ins->opcode];
         for (uint8_t j = 0; j < arg_count; j++) {
-            Argument arg;
-            int parse_result = parse_argument_token(&arg, &ins->arguments[j], labels, source_file);
-            if (parse_result != 0) {
-                got_error = true;
-                break;
+            Argument *arg = &ins->values[j];
+            if (arg->reference == NO_REFERENCE) {
+                continue;
+            }
+
+            Relocation relocation = {LOCAL_RELOCATION, offset + (uint32_t) get_argument_value_offset(j), 0};
+            if (arg->reference == IMPORT_REFERENCE) {
+                relocation.kind = IMPORT_RELOCATION;
+                relocation.import = (uint32_t) arg->value;
+                arg->value = 0;
+            }
+            if (append_relocation_list_value(relocations, &relocation) != 0) {
+                return -1;
             }
-            uint8_t arg_type = (uint8_t) arg.type;
-            fwrite(&arg_type, sizeof(uint8_t), 1, outfile);
-            write_i32_big(outfile, arg.value);
         }
-        if (got_error) {
-            break;
+        offset += (uint32_t) get_instruction_size(ins->opcode);
+    }
+    return 0;
+}
+
+
+int write_object_output(
+        const char *output_file, const ImageHeader *header, uint8_t meta_mask,
+        InstructionList *instructions, const LabelMap *labels, const LabelMap *imports,
+        size_t threads, Arena *arena
+    ) {
+    RelocationList relocations;
+    if (create_relocation_list(&relocations, INITAL_LABEL_CAPACITY, arena) != 0) {
+        return -1;
+    }
+
+    int error_code = collect_relocations(&relocations, instructions);
+    uint8_t *code = NULL;
+    size_t code_size;
+    if (error_code == 0) {
+        code = encode_instructions(&code_size, instructions, 0, 0, threads, arena);
+        if (code == NULL) {
+            error_code = -1;
+        }
+    }
+
+    if (error_code == 0) {
+        ObjectContents contents = {
+            header, meta_mask,
+            code, code_size,
+            labels, imports, &relocations
+        };
+        error_code = write_object_file(output_file, &contents, arena);
+    }
+    return error_code;
+}
+
+
+int write_instruction_source_map(
+        SourceFile *file, const char *map_file,
+        const InstructionList *instructions, const LabelMap *labels, Arena *arena
+    ) {
+    SourceLocation *locations = arena_alloc(arena, (instructions->size + 1) * sizeof(SourceLocation));
+    SourceMapLabel *map_labels = arena_alloc(arena, (labels->size + 1) * sizeof(SourceMapLabel));
+    if (locations == NULL || map_labels == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < instructions->size; i++) {
+        Instruction *ins = get_instruction_list_value(instructions, i);
+        locations[i].file = 0;
+        get_source_location(&locations[i].line, &locations[i].column, &file->lines, ins->token.offset);
+        locations[i].line++;
+        locations[i].column++;
+    }
+
+    size_t amount_labels = 0;
+    for (size_t i = 0; i < labels->capacity; i++) {
+        const LabelMapNode *node = &labels->data[i];
+        if (node->key != NULL) {
+            map_labels[amount_labels].name = node->key;
+            map_labels[amount_labels].index = node->value;
+            amount_labels++;
         }
     }
 
-    // TODO: data entries
-    write_i32_big(outfile, 0);
-    
-    fclose(outfile);
+    return write_source_map(
+        map_file, file->name,
+        locations, instructions->size,
+        map_labels, amount_labels
+    );
+}
 
-    if (got_error) {
+
+// Size `#memory` to fit the program when it declares variables, or check an explicit value against it.
+int fit_memory(
+        ImageHeader *header, uint8_t meta_mask, const Token *memory_token,
+        const VariableAllocation *allocation, size_t amount_variables,
+        SourceFile *file, bool object_output
+    ) {
+    int32_t memory = header->meta_vars[0];
+    if ((meta_mask & 1) == 0) {
+        if (amount_variables > 0) {
+            header->meta_vars[0] = allocation->has_indirect_access && memory > allocation->memory_used
+                ? memory
+                : (int32_t) allocation->memory_used;
+        }
+        return 0;
+    }
+
+    if (memory < allocation->memory_used && amount_variables > 0) {
+        token_error(memory_token, file, "Memory variables do not fit in #memory.");
         return -1;
     }
+
+    // A module in an object file only sees part of the program
+    if (memory > allocation->memory_used && !allocation->has_indirect_access && !object_output) {
+        char message[96];
+        snprintf(message, sizeof(message), "#memory is larger than the %lld addresses the program touches.", (long long) allocation->memory_used);
+        token_warning(memory_token, file, message);
+    }
     return 0;
 }
 
 
-int assemble_file(const char *input_file, const char *output_file) {
+int assemble_file(const char *input_file, const char *output_file, const AssemblerOptions *options) {
+    // Every allocation of this run comes from this arena and is released with it
+    Arena local_arena;
+    Arena *arena = options->arena;
+    if (arena == NULL) {
+        if (create_arena(&local_arena, ARENA_CHUNK_SIZE) != 0) {
+            fprintf(stderr, "Failed to initialize arena.\n");
+            return -3;
+        }
+        arena = &local_arena;
+    }
+    else {
+        reset_arena(arena);
+    }
+
     Lexer lexer;
     char *file_content;
     size_t file_length;
-    int read_result = read_file_bytes(&file_content, &file_length, input_file);
+    int read_result;
+    if (strcmp(input_file, STDIO_PATH) == 0) {
+        read_result = read_stream_bytes(&file_content, &file_length, stdin, arena);
+        input_file = STDIN_NAME;
+    }
+    else {
+        read_result = read_file_bytes(&file_content, &file_length, input_file, arena);
+    }
     if (read_result != 0) {
-        printf("Failed to read input file.\n");
+        fprintf(stderr, "Failed to read input file.\n");
+        if (arena == &local_arena) {
+            free_arena(arena);
+        }
         return -1;
     }
 
+    SourceFile file = {input_file, file_content, {0}};
+    create_line_index(&file.lines, file_content, file_length, arena);
+
     int lexer_result = create_lexer(&lexer, file_content, file_length);
     if (lexer_result != 0) {
-        printf("Failed to initialize lexer.\n");
+        fprintf(stderr, "Failed to initialize lexer.\n");
+        if (arena == &local_arena) {
+            free_arena(arena);
+        }
         return -2;
     }
 
     AssemblerState state = META;
 
-    List instructions;
-    create_list(&instructions, sizeof(Instruction), 32);
+    bool got_error = false;
 
-    Map labels;
-    create_map(&labels, INITAL_LABEL_CAPACITY);
+    // Labels referenced but not defined become imports in object files
+    InstructionList instructions = {0};
+    LabelMap labels = {0}, variables = {0}, imports = {0};
+    if (
+        create_instruction_list(&instructions, INITIAL_INSTRUCTION_CAPACITY, arena) != 0
+        || create_label_map(&labels, INITAL_LABEL_CAPACITY, arena) != 0
+        || create_label_map(&variables, INITAL_LABEL_CAPACITY, arena) != 0
+        || create_label_map(&imports, INITAL_LABEL_CAPACITY, arena) != 0
+    ) {
+        fprintf(stderr, "Failed to allocate symbol tables.\n");
+        got_error = true;
+    }
 
-    int32_t meta_vars[AMOUNT_META_VARS] = {DEFAULT_MEMORY, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_TICKRATE};
+    ImageHeader header = {
+        {DEFAULT_MEMORY, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_TICKRATE},
+        -1, -1, 0,
+        options->verify ? VERIFIED_IMAGE_VERSION : IMAGE_VERSION, 0
+    };
+    uint8_t meta_mask = 0;
+    Token memory_token;
     int32_t instruction_index = 0;
 
-    bool got_error = false;
-
     while (!lexer.is_done && !got_error) {
         Token token;
         int next_response = lexer_next(&lexer, &token);
         if (next_response < 0) {
-            error(lexer.source_line+1, lexer.source_column+1, input_file, "Unrecognized token.");
+            error(get_lexer_offset(&lexer), &file, "Unrecognized token.");
+            got_error = true;
             break;
         }
         if (next_response == 1) {
@@ -251,25 +577,61 @@ int assemble_file(const char *input_file, const char *output_file) {
         switch (token.type) {
             case META_VARIABLE:
                 if (state != META) {
-                    token_error(&token, input_file, "Found meta variable outside file header.");
+                    token_error(&token, &file, "Found meta variable outside file header.");
                     got_error = true;
                     break;
                 }
 
                 char meta_var[16];
-                copy_token_value(meta_var, &token);
+                if (token.length >= sizeof(meta_var)) {
+                    token_error(&token, &file, "Unrecognized meta variable.");
+                    got_error = true;
+                    break;
+                }
+                copy_token_value(meta_var, file.text, &token);
+
+                // Variable declaration
+                if (strcmp(meta_var+1, VARIABLE_META_VAR) == 0) {
+                    Token name_token;
+                    if (lexer_next(&lexer, &name_token) != 0 || name_token.type != NAME) {
+                        token_error(&token, &file, "Expected variable name.");
+                        got_error = true;
+                        break;
+                    }
+
+                    const char *name_start = get_token_text(file.text, &name_token);
+                    if (get_label_map_value(NULL, &variables, name_start, name_token.length) == 0) {
+                        token_error(&name_token, &file, "Variable declared more than once.");
+                        got_error = true;
+                        break;
+                    }
+
+                    char *variable_name = arena_copy_string(arena, name_start, name_token.length);
+                    if (variable_name == NULL || add_label_map_value(&variables, variable_name, (int32_t) variables.size) != 0) {
+                        fprintf(stderr, "Failed to allocate variable.\n");
+                        got_error = true;
+                    }
+                    break;
+                }
+
                 int index = get_meta_var_index(meta_var+1);  // Cut off '#'
                 if (index == -1) {
-                    token_error(&token, input_file, "Unrecognized meta variable.");
+                    token_error(&token, &file, "Unrecognized meta variable.");
                     got_error = true;
                     break;
                 }
 
                 Token value_token;
-                lexer_next(&lexer, &value_token);
-                char var_value[16];
-                copy_token_value(var_value, &value_token);
-                meta_vars[index] = atoi(var_value);
+                if (lexer_next(&lexer, &value_token) != 0 || value_token.type != INTEGER) {
+                    token_error(&token, &file, "Expected integer value for meta variable.");
+                    got_error = true;
+                    break;
+                }
+                header.meta_vars[index] = (int32_t) strtol(get_token_text(file.text, &value_token), NULL, 10);
+                meta_mask |= 1 << index;
+                if (index == 0) {
+                    memory_token = token;
+                }
                 break;
             
             case LABEL_NAME:
@@ -277,29 +639,32 @@ int assemble_file(const char *input_file, const char *output_file) {
                     state = SUBROUTINES;
                 }
                 
-                char *label_name = get_token_value(&token);
-                label_name[token.length-1] = '\0';  // Cut off ':'
+                const char *label_start = get_token_text(file.text, &token);
+                size_t label_length = token.length - 1;  // Cut off ':'
 
                 // Check if the label was already declared
-                if (get_map_value(NULL, &labels, label_name) == 0) {
-                    token_error(&token, input_file, "Label declared more than once.");
-                    free(label_name);
+                if (get_label_map_value(NULL, &labels, label_start, label_length) == 0) {
+                    token_error(&token, &file, "Label declared more than once.");
                     got_error = true;
                     break;
                 }
-                else {
-                    void *ins_index_ptr = malloc(sizeof(int32_t));
-                    *(int32_t*) ins_index_ptr = instruction_index;
-                    add_map_value(&labels, label_name, ins_index_ptr);
+
+                char *label_name = arena_copy_string(arena, label_start, label_length);
+                if (label_name == NULL || add_label_map_value(&labels, label_name, instruction_index) != 0) {
+                    fprintf(stderr, "Failed to allocate label.\n");
+                    got_error = true;
                 }
                 break;
             
             case NAME:
                 char instruction[16];
-                copy_token_value(instruction, &token);
-                int opcode = get_instruction_opcode(instruction);
+                int opcode = -1;
+                if (token.length < sizeof(instruction)) {
+                    copy_token_value(instruction, file.text, &token);
+                    opcode = get_instruction_opcode(instruction);
+                }
                 if (opcode == -1) {
-                    token_error(&token, input_file, "Unrecognized instruction.");
+                    token_error(&token, &file, "Unrecognized instruction.");
                     got_error = true;
                     break;
                 }
@@ -307,19 +672,24 @@ int assemble_file(const char *input_file, const char *output_file) {
                 uint8_t arg_count = ARGUMENT_COUNTS[opcode];
                 Instruction ins;
                 ins.opcode = opcode;
-                int args_result = get_instruction_args(ins.arguments, arg_count, &lexer, input_file);
+                ins.token = token;
+                int args_result = get_instruction_args(ins.arguments, arg_count, &lexer, &variables, &file);
                 if (args_result == -1) {
                     got_error = true;
                     break;
                 }
-                append_list_value(&instructions, &ins);
+                if (append_instruction_list_value(&instructions, &ins) != 0) {
+                    fprintf(stderr, "Failed to allocate instruction.\n");
+                    got_error = true;
+                    break;
+                }
 
                 instruction_index++;
                 break;
             
             case INTEGER:
             case ADDRESS:
-                token_error(&token, input_file, "Got value outside of instruction.");
+                token_error(&token, &file, "Got value outside of instruction.");
                 got_error = true;
                 break;
             
@@ -329,36 +699,114 @@ int assemble_file(const char *input_file, const char *output_file) {
         }
     }
 
+    VariableAllocation allocation;
+    if (!got_error && options->object_output && variables.size > 0) {
+        fprintf(stderr, "Memory variables are not supported in object files.\n");
+        got_error = true;
+    }
     if (!got_error) {
-        void *start_label_ptr, *tick_label_ptr;
-        int32_t start_label = -1, tick_label = -1;
-        if (get_map_value(&start_label_ptr, &labels, "start") == 0) {
-            start_label = *(int32_t*) start_label_ptr;
+        int allocate_result = allocate_variables(&allocation, &variables, &instructions, &labels, file.text, arena);
+        if (allocate_result == -2) {
+            fprintf(stderr, "\x1b[31mERROR (%s): Memory variables do not fit above the highest numeric address.\n", file.name);
+            got_error = true;
+        }
+        else if (allocate_result != 0) {
+            fprintf(stderr, "Failed to allocate variables.\n");
+            got_error = true;
         }
-        if (get_map_value(&tick_label_ptr, &labels, "tick") == 0) {
-            tick_label = *(int32_t*) tick_label_ptr;
+    }
+    if (!got_error) {
+        got_error = fit_memory(&header, meta_mask, &memory_token, &allocation, variables.size, &file, options->object_output) != 0;
+    }
+
+    if (!got_error && options->object_output) {
+        if (collect_imports(&imports, &instructions, &labels, file.text, arena) != 0) {
+            fprintf(stderr, "Failed to allocate imports.\n");
+            got_error = true;
         }
+    }
 
-        write_output_file(
-            input_file, output_file,
-            meta_vars, &instructions, &labels,
-            start_label, tick_label
-        );
+    if (!got_error) {
+        SymbolTables symbols = {file.text, &labels, options->object_output ? &imports : NULL, &variables};
+        got_error = resolve_instructions(&instructions, &symbols, &file, options->threads) != 0;
     }
 
-    // Free memory
-    free_list(&instructions);
+    OptimizationStats draw_stats = {0, 0};
+    OptimizationStats folding_stats = {0, 0};
+    if (!got_error && options->optimize) {
+        if (coalesce_draw_calls(&instructions, &labels, &draw_stats, arena) != 0) {
+            fprintf(stderr, "Failed to optimize draw calls.\n");
+            got_error = true;
+        }
+        else if (fold_identical_code(&instructions, &labels, &folding_stats, arena) != 0) {
+            fprintf(stderr, "Failed to fold identical code.\n");
+            got_error = true;
+        }
+    }
 
-    for (size_t i = 0; i < labels.size; i++) {
-        MapNode *node = &labels.data[i];
-        if (node->key != NULL) {
-            free(node->key);
-            free(node->value);
+    if (!got_error) {
+        get_label_map_value(&header.start_label, &labels, "start", 5);
+        get_label_map_value(&header.tick_label, &labels, "tick", 4);
+        header.instruction_count = (uint32_t) instructions.size;
+
+        int write_result;
+        if (options->object_output) {
+            write_result = write_object_output(
+                output_file, &header, meta_mask,
+                &instructions, &labels, &imports, options->threads, arena
+            );
+        }
+        else {
+            write_result = write_output_file(output_file, &header, &instructions, &file, options->threads, arena);
+        }
+        if (write_result == -2) {
+            got_error = true;
+        }
+        else if (write_result != 0) {
+            fprintf(stderr, "Failed to write output file.\n");
+            got_error = true;
+        }
+
+        if (!got_error && options->source_map_file != NULL) {
+            int map_result = write_instruction_source_map(
+                &file, options->source_map_file,
+                &instructions, &labels, arena
+            );
+            if (map_result != 0) {
+                fprintf(stderr, "Failed to write source map.\n");
+                got_error = true;
+            }
         }
     }
-    free_map(&labels);
 
-    free(file_content);
+    if (options->verbose) {
+        if (!got_error) {
+            fprintf(
+                stderr, "Variables: %zu declared in %zu addresses, %lld addresses used.\n",
+                variables.size, allocation.amount_slots, (long long) allocation.memory_used
+            );
+        }
+        if (!got_error && options->optimize) {
+            fprintf(
+                stderr, "Draw call coalescing: removed %zu instructions, saved %zu bytes.\n",
+                draw_stats.removed_instructions, draw_stats.saved_bytes
+            );
+            fprintf(
+                stderr, "Identical code folding: removed %zu instructions, saved %zu bytes.\n",
+                folding_stats.removed_instructions, folding_stats.saved_bytes
+            );
+        }
+        fprintf(stderr, "Arena: %zu bytes used.\n", arena_bytes_used(arena));
+    }
+
+    // Free memory
+    free_lexer(&lexer);
+    if (arena == &local_arena) {
+        free_arena(arena);
+    }
 
+    if (got_error) {
+        return -4;
+    }
     return 0;
 }
\ No newline at end of file
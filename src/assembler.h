@@ -2,7 +2,39 @@
 #define G1_ASSEMBLER_H
 
 
-int assemble_file(const char *input_file, const char *output_file);
+#include <stdbool.h>
+#include <stdlib.h>
+#include "arena.h"
 
+typedef struct {
+    // Path to write a source map to, or NULL to skip it.
+    const char *source_map_file;
 
-#endif
\ No newline at end of file
+    // Arena that owns every allocation of a run, or NULL to use a temporary one.
+    // A caller assembling many files can pass the same arena to reuse its memory;
+    // it is reset at the start of each run.
+    Arena *arena;
+
+    // Write a relocatable object instead of an image. Undefined labels become imports.
+    bool object_output;
+
+    // Run optimization passes over the instructions before encoding them.
+    bool optimize;
+
+    // Check addresses and jump targets against #memory and the instruction count, and write a
+    // version 2 image that records which checks passed. Not allowed for object files.
+    bool verify;
+
+    // Amount of threads used to encode instructions, or 0 to pick one per core.
+    // Small programs are always encoded on the calling thread.
+    size_t threads;
+
+    // Print statistics after assembling.
+    bool verbose;
+} AssemblerOptions;
+
+
+int assemble_file(const char *input_file, const char *output_file, const AssemblerOptions *options);
+
+
+#endif
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include "util.h"
+#include "image.h"
+
+
+const char *META_VARIABLES[AMOUNT_META_VARS] = {
+    "memory",
+    "width",
+    "height",
+    "tickrate"
+};
+
+
+int get_meta_var_index(const char *s) {
+    for (int i = 0; i < AMOUNT_META_VARS; i++) {
+        if (strcmp(s, META_VARIABLES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+void put_image_header(uint8_t *image, size_t image_size, const ImageHeader *header) {
+    // Write signature, followed by the flags in version 2 images
+    image[0] = 'g';
+    image[1] = (uint8_t) ('0' + header->version);
+    uint8_t *fields = image + 2;
+    if (header->version >= VERIFIED_IMAGE_VERSION) {
+        *fields++ = header->flags;
+    }
+
+    // Write meta vars
+    put_i32_big(fields, (uint32_t) header->meta_vars[0]);
+    put_i16_big(fields + 4, (uint16_t) header->meta_vars[1]);
+    put_i16_big(fields + 6, (uint16_t) header->meta_vars[2]);
+    put_i16_big(fields + 8, (uint16_t) header->meta_vars[3]);
+
+    // Write start and tick labels
+    put_i32_big(fields + 10, (uint32_t) header->tick_label);
+    put_i32_big(fields + 14, (uint32_t) header->start_label);
+
+    // Write instruction count
+    put_i32_big(fields + 18, header->instruction_count);
+
+    // TODO: data entries
+    put_i32_big(image + image_size - IMAGE_TRAILER_SIZE, 0);
+}
+
+
+int write_image_file(const char *output_file, const uint8_t *image, size_t image_size) {
+    FILE *outfile = open_output_stream(output_file);
+    if (outfile == NULL) {
+        return -1;
+    }
+
+    size_t written = fwrite(image, sizeof(uint8_t), image_size, outfile);
+    int close_result = close_output_stream(outfile);
+
+    if (written != image_size || close_result != 0) {
+        return -1;
+    }
+    return 0;
+}
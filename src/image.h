@@ -0,0 +1,57 @@
+#ifndef G1_IMAGE_H
+#define G1_IMAGE_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+#define AMOUNT_META_VARS 4
+
+#define DEFAULT_MEMORY 128
+#define DEFAULT_WIDTH 100
+#define DEFAULT_HEIGHT 100
+#define DEFAULT_TICKRATE 60
+
+#define IMAGE_HEADER_SIZE 24UL
+#define IMAGE_TRAILER_SIZE 4UL
+
+// Version 2 images have the signature "g2" and a flags byte after it, followed by the version 1 layout
+#define IMAGE_VERSION 1
+#define VERIFIED_IMAGE_VERSION 2
+
+// Flags in a version 2 header. A VM may skip the runtime checks a set flag covers.
+// Every address argument is below #memory, and the program does not use `movp`
+#define IMAGE_MEMORY_VERIFIED 0x01
+// Every jump target is a literal between 0 and the instruction count
+#define IMAGE_JUMPS_VERIFIED 0x02
+
+
+typedef struct {
+    int32_t meta_vars[AMOUNT_META_VARS];
+    int32_t start_label, tick_label;
+    uint32_t instruction_count;
+
+    uint8_t version, flags;
+} ImageHeader;
+
+
+extern const char *META_VARIABLES[AMOUNT_META_VARS];
+
+
+// Returns the index of the meta variable named `s`, or -1.
+int get_meta_var_index(const char *s);
+
+// Returns the size of the header `header` is written as.
+static inline size_t get_image_header_size(const ImageHeader *header) {
+    return header->version >= VERIFIED_IMAGE_VERSION ? IMAGE_HEADER_SIZE + 1 : IMAGE_HEADER_SIZE;
+}
+
+// Fill in the header at the start of `image` and the empty data section at its end.
+void put_image_header(uint8_t *image, size_t image_size, const ImageHeader *header);
+
+// Write a complete image to `output_file`, or to stdout if it is "-".
+int write_image_file(const char *output_file, const uint8_t *image, size_t image_size);
+
+
+#endif
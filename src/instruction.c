@@ -0,0 +1,12 @@
+#include <string.h>
+#include "instruction.h"
+
+
+int get_instruction_opcode(const char *s) {
+    for (int i = 0; i < AMOUNT_INSTRUCTIONS; i++) {
+        if (strcmp(s, INSTRUCTIONS[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
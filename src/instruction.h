@@ -0,0 +1,105 @@
+#ifndef G1_INSTRUCTION_H
+#define G1_INSTRUCTION_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "lexer.h"
+#include "list.h"
+#include "map.h"
+
+// Generated from src/isa.def: AMOUNT_INSTRUCTIONS, MAX_ARGUMENTS, the Opcode enum and the
+// encoding layout
+#include "isa.h"
+
+
+typedef enum {
+    LITERAL_ARG,
+    ADDRESS_ARG
+} ArgumentType;
+
+
+typedef enum {
+    NO_REFERENCE,
+    LABEL_REFERENCE,
+    IMPORT_REFERENCE
+} ReferenceKind;
+
+
+typedef struct {
+    ArgumentType type;
+    int32_t value;
+
+    // Whether `value` is the index of a label in this module, or of an import
+    ReferenceKind reference;
+} Argument;
+
+
+typedef struct {
+    uint8_t opcode;
+    Token token;
+
+    // Argument tokens as written, and their values once resolved
+    Token arguments[MAX_ARGUMENTS];
+    Argument values[MAX_ARGUMENTS];
+} Instruction;
+
+
+DEFINE_TYPED_LIST(InstructionList, instruction_list, Instruction)
+
+DEFINE_TYPED_MAP(LabelMap, label_map, int32_t)
+
+
+// Tables used to resolve argument tokens, and the source the tokens point into.
+// `imports` and `variables` may be NULL.
+typedef struct {
+    const char *source;
+    const LabelMap *labels, *imports, *variables;
+} SymbolTables;
+
+
+// The tables and coding functions below are generated from src/isa.def.
+
+extern const char *INSTRUCTIONS[AMOUNT_INSTRUCTIONS];
+
+extern const uint8_t ARGUMENT_COUNTS[AMOUNT_INSTRUCTIONS];
+
+// Encoded size of every instruction in bytes.
+extern const uint8_t INSTRUCTION_SIZES[AMOUNT_INSTRUCTIONS];
+
+// Whether an instruction stores its result in the address given by its first argument.
+extern const bool WRITES_FIRST_ARGUMENT[AMOUNT_INSTRUCTIONS];
+
+
+// Write the encoding of an instruction to `dest`. Returns the position after it.
+uint8_t* encode_instruction(uint8_t *dest, uint8_t opcode, const Argument *values);
+
+// Decode the instruction at `src` into `opcode` and `values`. Returns its size in bytes, or 0 if
+// the `available` bytes at `src` do not start with a valid instruction.
+size_t decode_instruction(uint8_t *opcode, Argument *values, const uint8_t *src, size_t available);
+
+// Returns the index of the first argument whose type the instruction does not allow, or -1.
+int validate_instruction(uint8_t opcode, const Argument *values);
+
+
+// Returns the opcode of the instruction named `s`, or -1.
+int get_instruction_opcode(const char *s);
+
+// Returns the encoded size of an instruction in bytes.
+static inline size_t get_instruction_size(uint8_t opcode) {
+    return INSTRUCTION_SIZES[opcode];
+}
+
+
+// Returns whether `token` names a memory variable (`$name`) rather than a numeric address.
+static inline bool is_variable_token(const char *source, const Token *token) {
+    if (token->type != ADDRESS) {
+        return false;
+    }
+    char c = source[token->offset + 1];  // Skip '$'
+    return c < '0' || c > '9';
+}
+
+
+#endif
@@ -0,0 +1,239 @@
+# Generates the instruction set sources from src/isa.def.
+#
+#   awk -v output=header -f src/isa.awk src/isa.def > build/isa.h
+#   awk -v output=source -f src/isa.awk src/isa.def > build/isa.c
+#
+# The header holds the opcode enum, the encoding layout and sizes, the source holds the lookup
+# tables, an unrolled encoder and decoder for every opcode, and the argument validator. Every
+# offset into an encoded instruction comes from the layout set up in BEGIN.
+
+function fail(message) {
+    printf("%s:%d: %s\n", FILENAME, FNR, message) > "/dev/stderr"
+    failed = 1
+    exit 1
+}
+
+function enum_name(opcode) {
+    return toupper(names[opcode]) "_OP"
+}
+
+function instruction_size(opcode) {
+    return opcode_size + argument_size * counts[opcode]
+}
+
+function type_offset(argument) {
+    return opcode_size + argument_size * argument
+}
+
+function value_offset(argument) {
+    return type_offset(argument) + type_size
+}
+
+function write_header(    i) {
+    print "// Generated from src/isa.def by src/isa.awk, do not edit."
+    print "#ifndef G1_ISA_H"
+    print "#define G1_ISA_H"
+    print ""
+    print "#include <stdlib.h>"
+    print "#include <stdint.h>"
+    print ""
+    print ""
+    printf("#define AMOUNT_INSTRUCTIONS %d\n", amount)
+    printf("#define MAX_ARGUMENTS %d\n", max_arguments)
+    print ""
+    print ""
+    print "typedef enum {"
+    for (i = 0; i < amount; i++) {
+        printf("    %s = %d%s\n", enum_name(i), i, i + 1 < amount ? "," : "")
+    }
+    print "} Opcode;"
+    print ""
+    print ""
+    print "// Returns the offset of the value of argument `argument` from the start of its instruction."
+    print "static inline size_t get_argument_value_offset(uint8_t argument) {"
+    printf("    return %d + %d * (size_t) argument;\n", value_offset(0), argument_size)
+    print "}"
+    print ""
+    print ""
+    print "#endif"
+}
+
+function write_tables(    i, line) {
+    line = ""
+    for (i = 0; i < amount; i++) {
+        line = line sprintf("%s\"%s\"", i > 0 ? ", " : "", names[i])
+    }
+    printf("const char *INSTRUCTIONS[AMOUNT_INSTRUCTIONS] = {%s};\n\n", line)
+
+    line = ""
+    for (i = 0; i < amount; i++) {
+        line = line sprintf("%s%d", i > 0 ? ", " : "", counts[i])
+    }
+    printf("const uint8_t ARGUMENT_COUNTS[AMOUNT_INSTRUCTIONS] = {%s};\n\n", line)
+
+    line = ""
+    for (i = 0; i < amount; i++) {
+        line = line sprintf("%s%d", i > 0 ? ", " : "", instruction_size(i))
+    }
+    printf("const uint8_t INSTRUCTION_SIZES[AMOUNT_INSTRUCTIONS] = {%s};\n\n", line)
+
+    line = ""
+    for (i = 0; i < amount; i++) {
+        line = line sprintf("%s%s", i > 0 ? ", " : "", kinds[i, 0] == "dest" ? "true" : "false")
+    }
+    printf("const bool WRITES_FIRST_ARGUMENT[AMOUNT_INSTRUCTIONS] = {%s};\n", line)
+}
+
+function write_encoder(opcode,    j) {
+    printf("\n\nstatic uint8_t* encode_%s(uint8_t *dest, const Argument *values) {\n", names[opcode])
+    if (counts[opcode] == 0) {
+        print "    (void) values;"
+    }
+    printf("    dest[0] = %s;\n", enum_name(opcode))
+    for (j = 0; j < counts[opcode]; j++) {
+        printf("    dest[%d] = (uint8_t) values[%d].type;\n", type_offset(j), j)
+        printf("    put_i32_big(dest + %d, (uint32_t) values[%d].value);\n", value_offset(j), j)
+    }
+    printf("    return dest + %d;\n", instruction_size(opcode))
+    print "}"
+}
+
+function write_decoder(opcode,    j, valid) {
+    printf("\n\nstatic bool decode_%s(Argument *values, const uint8_t *src) {\n", names[opcode])
+    if (counts[opcode] == 0) {
+        print "    (void) values;"
+        print "    (void) src;"
+    }
+    valid = ""
+    for (j = 0; j < counts[opcode]; j++) {
+        printf("    values[%d].type = (ArgumentType) src[%d];\n", j, type_offset(j))
+        printf("    values[%d].value = (int32_t) get_i32_big(src + %d);\n", j, value_offset(j))
+        printf("    values[%d].reference = NO_REFERENCE;\n", j)
+        valid = valid sprintf("%ssrc[%d] <= ADDRESS_ARG", j > 0 ? " && " : "", type_offset(j))
+    }
+    printf("    return %s;\n", valid != "" ? valid : "true")
+    print "}"
+}
+
+function write_dispatch(    i, j, has_dest) {
+    print ""
+    print ""
+    print "uint8_t* encode_instruction(uint8_t *dest, uint8_t opcode, const Argument *values) {"
+    print "    switch (opcode) {"
+    for (i = 0; i < amount; i++) {
+        printf("        case %s: return encode_%s(dest, values);\n", enum_name(i), names[i])
+    }
+    print "    }"
+    print "    return dest;"
+    print "}"
+
+    print ""
+    print ""
+    print "size_t decode_instruction(uint8_t *opcode, Argument *values, const uint8_t *src, size_t available) {"
+    print "    if (available == 0 || src[0] >= AMOUNT_INSTRUCTIONS || available < get_instruction_size(src[0])) {"
+    print "        return 0;"
+    print "    }"
+    print "    bool valid = false;"
+    print "    switch (src[0]) {"
+    for (i = 0; i < amount; i++) {
+        printf("        case %s: valid = decode_%s(values, src); break;\n", enum_name(i), names[i])
+    }
+    print "    }"
+    print "    *opcode = src[0];"
+    print "    return valid ? get_instruction_size(src[0]) : 0;"
+    print "}"
+
+    print ""
+    print ""
+    print "int validate_instruction(uint8_t opcode, const Argument *values) {"
+    print "    switch (opcode) {"
+    for (i = 0; i < amount; i++) {
+        has_dest = 0
+        for (j = 0; j < counts[i]; j++) {
+            if (kinds[i, j] != "dest") {
+                continue
+            }
+            if (!has_dest) {
+                printf("        case %s:\n", enum_name(i))
+                has_dest = 1
+            }
+            printf("            if (values[%d].type != ADDRESS_ARG) {\n", j)
+            printf("                return %d;\n", j)
+            print "            }"
+        }
+        if (has_dest) {
+            print "            break;"
+        }
+    }
+    print "    }"
+    print "    return -1;"
+    print "}"
+}
+
+function write_source(    i) {
+    print "// Generated from src/isa.def by src/isa.awk, do not edit."
+    print "#include \"util.h\""
+    print "#include \"instruction.h\""
+    print ""
+    print ""
+    write_tables()
+    for (i = 0; i < amount; i++) {
+        write_encoder(i)
+    }
+    for (i = 0; i < amount; i++) {
+        write_decoder(i)
+    }
+    write_dispatch()
+}
+
+BEGIN {
+    amount = 0
+    max_arguments = 0
+
+    # Encoding layout, in bytes. put_i32_big and get_i32_big code the 4 byte values.
+    opcode_size = 1
+    type_size = 1
+    value_size = 4
+    argument_size = type_size + value_size
+}
+
+/^[ \t]*(#|$)/ {
+    next
+}
+
+{
+    if ($2 != amount "") {
+        fail("expected opcode " amount " for \"" $1 "\"")
+    }
+    names[amount] = $1
+    counts[amount] = NF - 2
+    for (j = 3; j <= NF; j++) {
+        if ($j != "dest" && $j != "value") {
+            fail("unknown argument kind \"" $j "\"")
+        }
+        if ($j == "dest" && j != 3) {
+            fail("only the first argument can be a destination")
+        }
+        kinds[amount, j - 3] = $j
+    }
+    if (counts[amount] > max_arguments) {
+        max_arguments = counts[amount]
+    }
+    amount++
+}
+
+END {
+    if (failed) {
+        exit 1
+    }
+    if (output == "header") {
+        write_header()
+    }
+    else if (output == "source") {
+        write_source()
+    }
+    else {
+        print "isa.awk: set output to header or source" > "/dev/stderr"
+        exit 1
+    }
+}
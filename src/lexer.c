@@ -10,7 +10,7 @@
 const char* TOKEN_EXPRESSIONS[AMOUNT_TOKEN_TYPES] = {
     "^#[A-z]+",
     "^-?[0-9]+",
-    "^\\$[0-9]+",
+    "^\\$([0-9]+|[A-z_][A-z0-9_]*)",
     "^[A-z0-9_]+:",
     "^[A-z_][A-z0-9_]*",
     "^;[^\r\n]*",
@@ -34,12 +34,14 @@ int compile_expressions(regex_t *expressions_dest, const char **expressions, siz
 
 
 int create_lexer(Lexer *lexer_dest, char *source, size_t source_length) {
+    if (source_length > UINT32_MAX) {
+        return -1;
+    }
+
     lexer_dest->source = source;
     lexer_dest->current_char_pointer = source;
     lexer_dest->end_char_pointer = source + source_length;
-    lexer_dest->source_index = 0;
-    lexer_dest->source_line = 0;
-    lexer_dest->source_column = 0;
+    lexer_dest->line_end_pointer = source;
     lexer_dest->is_done = false;
 
     int comp_result_1 = compile_expressions(lexer_dest->token_expressions, TOKEN_EXPRESSIONS, AMOUNT_TOKEN_TYPES);
@@ -52,6 +54,33 @@ int create_lexer(Lexer *lexer_dest, char *source, size_t source_length) {
 }
 
 
+void free_lexer(Lexer *lexer) {
+    for (size_t i = 0; i < AMOUNT_TOKEN_TYPES; i++) {
+        regfree(&lexer->token_expressions[i]);
+    }
+    for (size_t i = 0; i < AMOUNT_IGNORED_EXPRESSIONS; i++) {
+        regfree(&lexer->ignored_expressions[i]);
+    }
+}
+
+
+// Match `expression` at the current position, looking no further than the end of the line.
+static int match_expression(const regex_t *expression, Lexer *lexer, regmatch_t *match) {
+#ifdef REG_STARTEND
+    if (lexer->current_char_pointer >= lexer->line_end_pointer) {
+        size_t remaining = (size_t) (lexer->end_char_pointer - lexer->current_char_pointer);
+        const char *newline = memchr(lexer->current_char_pointer, '\n', remaining);
+        lexer->line_end_pointer = newline != NULL ? newline + 1 : lexer->end_char_pointer;
+    }
+    match->rm_so = 0;
+    match->rm_eo = lexer->line_end_pointer - lexer->current_char_pointer;
+    return regexec(expression, lexer->current_char_pointer, 1, match, REG_STARTEND);
+#else
+    return regexec(expression, lexer->current_char_pointer, 1, match, 0);
+#endif
+}
+
+
 int lexer_next(Lexer *lexer, Token *token_dest) {
     // Check if we've reached the end of the string
     if (lexer->is_done || lexer->current_char_pointer >= lexer->end_char_pointer) {
@@ -65,24 +94,13 @@ int lexer_next(Lexer *lexer, Token *token_dest) {
 
         // Check for tokens
         for (int i = 0; i < AMOUNT_TOKEN_TYPES; i++) {
-            regex_t current_expression = lexer->token_expressions[i];
-            if (regexec(&current_expression, lexer->current_char_pointer, 1, &match, 0) == 0) {
+            if (match_expression(&lexer->token_expressions[i], lexer, &match) == 0) {
                 // Create the token
-                token_dest->source = lexer->source;
+                token_dest->offset = get_lexer_offset(lexer);
+                token_dest->length = (uint32_t) match.rm_eo;
                 token_dest->type = (TokenType) i;
-                token_dest->source_index = lexer->source_index;
-                token_dest->length = match.rm_eo;
-                token_dest->source_line = lexer->source_line;
-                token_dest->source_column = lexer->source_column;
 
                 lexer->current_char_pointer += match.rm_eo;
-                lexer->source_index += match.rm_eo;
-                lexer->source_column += match.rm_eo;
-                if (i == NEWLINE) {
-                    lexer->source_line += 1;
-                    lexer->source_column = 0;
-                }
-                
                 return 0;
             }
         }
@@ -90,11 +108,8 @@ int lexer_next(Lexer *lexer, Token *token_dest) {
         // Check for ignored expressions
         bool is_ignored = false;
         for (int i = 0; i < AMOUNT_IGNORED_EXPRESSIONS; i++) {
-            regex_t current_expression = lexer->ignored_expressions[i];
-            if (regexec(&current_expression, lexer->current_char_pointer, 1, &match, 0) == 0) {
+            if (match_expression(&lexer->ignored_expressions[i], lexer, &match) == 0) {
                 lexer->current_char_pointer += match.rm_eo;
-                lexer->source_index += match.rm_eo;
-                lexer->source_column += match.rm_eo;
                 is_ignored = true;
                 break;
             }
@@ -111,14 +126,74 @@ int lexer_next(Lexer *lexer, Token *token_dest) {
 }
 
 
-void copy_token_value(char *dest, const Token *token) {
-    strncpy(dest, token->source+token->source_index, token->length);
+void copy_token_value(char *dest, const char *source, const Token *token) {
+    memcpy(dest, get_token_text(source, token), token->length);
     dest[token->length] = '\0';
 }
 
 
-char* get_token_value(const Token *token) {
-    char *value = malloc(token->length + 1);
-    copy_token_value(value, token);
-    return value;
-}
\ No newline at end of file
+void create_line_index(LineIndex *index, const char *source, size_t source_length, Arena *arena) {
+    index->source = source;
+    index->source_length = source_length;
+    index->arena = arena;
+    index->line_starts = NULL;
+    index->amount_lines = 0;
+    index->is_built = false;
+}
+
+
+static void build_line_index(LineIndex *index) {
+    index->is_built = true;
+
+    size_t amount_lines = 1;
+    const char *end = index->source + index->source_length;
+    for (const char *c = index->source; (c = memchr(c, '\n', (size_t) (end - c))) != NULL; c++) {
+        amount_lines++;
+    }
+
+    // Without an index, locations are found by scanning the source instead
+    index->line_starts = arena_alloc(index->arena, amount_lines * sizeof(uint32_t));
+    if (index->line_starts == NULL) {
+        return;
+    }
+
+    index->line_starts[0] = 0;
+    index->amount_lines = 1;
+    for (const char *c = index->source; (c = memchr(c, '\n', (size_t) (end - c))) != NULL; c++) {
+        index->line_starts[index->amount_lines++] = (uint32_t) (c + 1 - index->source);
+    }
+}
+
+
+void get_source_location(uint32_t *line, uint32_t *column, LineIndex *index, uint32_t offset) {
+    if (!index->is_built) {
+        build_line_index(index);
+    }
+
+    if (index->line_starts == NULL) {
+        *line = 0;
+        uint32_t line_start = 0;
+        for (uint32_t i = 0; i < offset && i < index->source_length; i++) {
+            if (index->source[i] == '\n') {
+                (*line)++;
+                line_start = i + 1;
+            }
+        }
+        *column = offset - line_start;
+        return;
+    }
+
+    // Find the last line that starts at or before `offset`
+    size_t low = 0, high = index->amount_lines;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (index->line_starts[middle] <= offset) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    *line = (uint32_t) low;
+    *column = offset - index->line_starts[low];
+}
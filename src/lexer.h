@@ -2,9 +2,11 @@
 #define G1_LEXER_H
 
 
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <regex.h>
+#include "arena.h"
 
 
 #define AMOUNT_TOKEN_TYPES 7
@@ -27,33 +29,67 @@ typedef struct {
     char *current_char_pointer;
     const char *end_char_pointer;
 
+    // End of the line that contains `current_char_pointer`. Matching stops there,
+    // since no token spans more than one line.
+    const char *line_end_pointer;
+
     regex_t token_expressions[AMOUNT_TOKEN_TYPES];
     regex_t ignored_expressions[AMOUNT_IGNORED_EXPRESSIONS];
 
-    uint64_t source_index, source_line, source_column;
-
     bool is_done;
 } Lexer;
 
 
+// A token is a span of the lexer's source. Use `get_source_location` for its line and column.
 typedef struct {
-    const char *source;
+    uint32_t offset, length;
     TokenType type;
-    uint64_t source_index, length, source_line, source_column;
 } Token;
 
 
-// Create a new lexer.
+// Offsets at which the lines of a source start. The index is built on the first lookup,
+// since only diagnostics and source maps need line and column numbers.
+typedef struct {
+    const char *source;
+    size_t source_length;
+
+    // Holds `line_starts` once the index is built
+    Arena *arena;
+    uint32_t *line_starts;
+    size_t amount_lines;
+    bool is_built;
+} LineIndex;
+
+
+// Create a new lexer. Sources must be shorter than 4 GiB.
 int create_lexer(Lexer *lexer_dest, char *source, size_t source_length);
 
+// Free the compiled expressions owned by `lexer`.
+void free_lexer(Lexer *lexer);
+
 // Get the next token from the lexer.
 int lexer_next(Lexer *lexer, Token *token_dest);
 
+// Returns the offset of the next character `lexer` reads.
+static inline uint32_t get_lexer_offset(const Lexer *lexer) {
+    return (uint32_t) (lexer->current_char_pointer - lexer->source);
+}
+
+// Returns a pointer to the text of `token` in `source`. The text is not terminated.
+static inline const char* get_token_text(const char *source, const Token *token) {
+    return source + token->offset;
+}
+
 // Copy the string value of `token` into `dest`.
-void copy_token_value(char *dest, const Token *token);
+void copy_token_value(char *dest, const char *source, const Token *token);
+
+
+// Create an empty index over `source`. The line offsets are allocated from `arena` when the
+// index is first used.
+void create_line_index(LineIndex *index, const char *source, size_t source_length, Arena *arena);
 
-// Returns an owned string containing the value of `token`.
-char* get_token_value(const Token *token);
+// Store the 0-based line and column of the byte at `offset` in `line` and `column`.
+void get_source_location(uint32_t *line, uint32_t *column, LineIndex *index, uint32_t offset);
 
 
 #endif
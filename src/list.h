@@ -2,25 +2,60 @@
 #define LIST_H
 
 #include <stdlib.h>
-
-
-typedef struct {
-    size_t element_size, size, capacity;
-    void *data;
-} List;
-
-
-// Create a new list.
-int create_list(List *list, size_t element_size, size_t capacity);
-
-// Free `list`.
-void free_list(const List *list);
-
-// Add a copy of `value` to the end of `list`.
-int append_list_value(List *list, void *value);
-
-// Returns a value from `list` at `index`.
-void* get_list_value(const List *list, size_t index);
-
-
-#endif
\ No newline at end of file
+#include <string.h>
+#include "arena.h"
+
+
+// Define a list type `list_type` that stores `element_type` values inline in memory from an arena.
+// Generates `create_<prefix>`, `reserve_<prefix>`, `append_<prefix>_value` and `get_<prefix>_value`.
+// Capacity grows geometrically: a full list copies its values into a new array and leaves the old
+// one to the arena, so the arrays a list ever used add up to less than twice its final capacity.
+#define DEFINE_TYPED_LIST(list_type, prefix, element_type) \
+    typedef struct { \
+        size_t size, capacity; \
+        element_type *data; \
+        Arena *arena; \
+    } list_type; \
+    \
+    static inline int reserve_##prefix(list_type *list, size_t capacity) { \
+        if (capacity <= list->capacity) { \
+            return 0; \
+        } \
+        size_t new_capacity = list->capacity > 0 ? list->capacity : 8; \
+        while (new_capacity < capacity) { \
+            new_capacity *= 2; \
+        } \
+        element_type *new_data = arena_alloc(list->arena, new_capacity * sizeof(element_type)); \
+        if (new_data == NULL) { \
+            return -1; \
+        } \
+        if (list->size > 0) { \
+            memcpy(new_data, list->data, list->size * sizeof(element_type)); \
+        } \
+        list->data = new_data; \
+        list->capacity = new_capacity; \
+        return 0; \
+    } \
+    \
+    static inline int create_##prefix(list_type *list, size_t capacity, Arena *arena) { \
+        list->size = 0; \
+        list->capacity = 0; \
+        list->data = NULL; \
+        list->arena = arena; \
+        return reserve_##prefix(list, capacity); \
+    } \
+    \
+    static inline int append_##prefix##_value(list_type *list, const element_type *value) { \
+        if (list->size == list->capacity && reserve_##prefix(list, list->size + 1) != 0) { \
+            return -1; \
+        } \
+        list->data[list->size++] = *value; \
+        return 0; \
+    } \
+    \
+    static inline element_type* get_##prefix##_value(const list_type *list, size_t index) { \
+        return &list->data[index]; \
+    }
+
+
+#endif
@@ -3,34 +3,86 @@
 #include <string.h>
 #include "util.h"
 #include "assembler.h"
+#include "object.h"
 
 
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        printf("usage: g1a [--data_path DATA_PATH] input_path output_path\n");
+        fprintf(stderr, "usage: g1a input_path output_path [-s SOURCE_MAP_PATH] [-c] [-O] [-V] [-j THREADS] [-v]\n");
+        fprintf(stderr, "       g1a link output_path object_path... [-V]\n");
         return 1;
     }
+
+    if (strcmp(argv[1], "link") == 0) {
+        // Flags may appear anywhere after the output path, the object paths are moved to the front
+        bool verify = false;
+        const char **object_paths = (const char**) argv + 3;
+        size_t amount_objects = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "-V") == 0) {
+                verify = true;
+            }
+            else if (argv[i][0] == '-') {
+                fprintf(stderr, "Got unrecognized flag \"%s\".\n", argv[i]);
+                return 2;
+            }
+            else {
+                object_paths[amount_objects++] = argv[i];
+            }
+        }
+        int link_result = link_object_files(argv[2], object_paths, amount_objects, verify);
+        return link_result != 0 ? 4 : 0;
+    }
     
     // Parse flags
-    char *data_file_path = NULL;
-    if (argc > 3) {
-        if (strcmp(argv[3], "-d") == 0) {
-            if (argc < 5) {
-                printf("Expected data file path.\n");
+    AssemblerOptions options = {0};
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Expected source map path.\n");
+                return 2;
+            }
+            options.source_map_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            options.object_output = true;
+        }
+        else if (strcmp(argv[i], "-O") == 0) {
+            options.optimize = true;
+        }
+        else if (strcmp(argv[i], "-V") == 0) {
+            options.verify = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Expected thread count.\n");
                 return 2;
             }
-            char *data_file_path = argv[4];
+            options.threads = (size_t) strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = true;
         }
         else {
-            printf("Got unrecognized flag \"%s\".\n", argv[3]);
+            fprintf(stderr, "Got unrecognized flag \"%s\".\n", argv[i]);
             return 2;
         }
     }
     
-    if (!file_exists(argv[1])) {
-        printf("File \"%s\" does not exist.\n", argv[1]);
+    if (options.verify && options.object_output) {
+        fprintf(stderr, "-V can not be used with -c. Pass -V to \"g1a link\" instead.\n");
+        return 2;
+    }
+
+    if (options.source_map_file != NULL && strcmp(options.source_map_file, STDIO_PATH) == 0 && strcmp(argv[2], STDIO_PATH) == 0) {
+        fprintf(stderr, "The image and the source map can not both be written to stdout.\n");
+        return 2;
+    }
+
+    if (strcmp(argv[1], STDIO_PATH) != 0 && !file_exists(argv[1])) {
+        fprintf(stderr, "File \"%s\" does not exist.\n", argv[1]);
         return 3;
     }
 
-    return assemble_file(argv[1], argv[2]);
-}
\ No newline at end of file
+    return assemble_file(argv[1], argv[2], &options);
+}
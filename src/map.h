@@ -3,27 +3,111 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include "arena.h"
 
 
-typedef struct {
-    char *key;
-    void *value;
-} MapNode;
+#define FNV_PRIME 1099511628211UL
+#define FNV_OFFSET 14695981039346656037UL
 
 
-typedef struct {
-    size_t size, capacity;
-    MapNode *data;
-} Map;
+// FNV-1a hash of the first `length` characters of `s`.
+static inline size_t fnv_hash_span(const char *s, size_t length) {
+    size_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ s[i]) * FNV_PRIME;
+    }
+    return hash;
+}
 
 
-int create_map(Map *map_dest, size_t capacity);
+// Define a string-keyed open addressing map `map_type` that stores `value_type`
+// values inline in memory from an arena. Generates `create_<prefix>`, `reserve_<prefix>`,
+// `add_<prefix>_value` and `get_<prefix>_value`. Growing rehashes into a table twice
+// the size and leaves the old one to the arena.
+// Keys are borrowed, and lookups take a length so they work on unterminated spans.
+#define DEFINE_TYPED_MAP(map_type, prefix, value_type) \
+    typedef struct { \
+        char *key; \
+        size_t hash; \
+        value_type value; \
+    } map_type##Node; \
+    \
+    typedef struct { \
+        size_t size, capacity; \
+        map_type##Node *data; \
+        Arena *arena; \
+    } map_type; \
+    \
+    static inline void insert_##prefix##_node(map_type *map, const map_type##Node *node) { \
+        size_t mask = map->capacity - 1; \
+        size_t index = node->hash & mask; \
+        while (map->data[index].key != NULL) { \
+            index = (index + 1) & mask; \
+        } \
+        map->data[index] = *node; \
+        map->size++; \
+    } \
+    \
+    static inline int reserve_##prefix(map_type *map, size_t amount) { \
+        size_t new_capacity = map->capacity > 0 ? map->capacity : 16; \
+        while (new_capacity / 2 < amount) { \
+            new_capacity *= 2; \
+        } \
+        if (new_capacity == map->capacity) { \
+            return 0; \
+        } \
+        map_type##Node *new_data = arena_calloc(map->arena, new_capacity, sizeof(map_type##Node)); \
+        if (new_data == NULL) { \
+            return -1; \
+        } \
+        map_type new_map = {0, new_capacity, new_data, map->arena}; \
+        for (size_t i = 0; i < map->capacity; i++) { \
+            if (map->data[i].key != NULL) { \
+                insert_##prefix##_node(&new_map, &map->data[i]); \
+            } \
+        } \
+        *map = new_map; \
+        return 0; \
+    } \
+    \
+    static inline int create_##prefix(map_type *map, size_t amount, Arena *arena) { \
+        map->size = 0; \
+        map->capacity = 0; \
+        map->data = NULL; \
+        map->arena = arena; \
+        return reserve_##prefix(map, amount); \
+    } \
+    \
+    static inline int add_##prefix##_value(map_type *map, char *key, value_type value) { \
+        if (map->size + 1 > map->capacity / 2 && reserve_##prefix(map, map->size + 1) != 0) { \
+            return -1; \
+        } \
+        map_type##Node node = {key, fnv_hash_span(key, strlen(key)), value}; \
+        insert_##prefix##_node(map, &node); \
+        return 0; \
+    } \
+    \
+    static inline int get_##prefix##_value(value_type *dest, const map_type *map, const char *key, size_t length) { \
+        if (map->capacity == 0) { \
+            return -1; \
+        } \
+        size_t mask = map->capacity - 1; \
+        size_t hash = fnv_hash_span(key, length); \
+        size_t index = hash & mask; \
+        const map_type##Node *node = &map->data[index]; \
+        while (node->key != NULL) { \
+            if (node->hash == hash && strncmp(node->key, key, length) == 0 && node->key[length] == '\0') { \
+                if (dest != NULL) { \
+                    *dest = node->value; \
+                } \
+                return 0; \
+            } \
+            index = (index + 1) & mask; \
+            node = &map->data[index]; \
+        } \
+        return -1; \
+    }
 
-void free_map(const Map *map);
 
-int add_map_value(Map *map, char *key, void *value);
-
-int get_map_value(void **dest, const Map *map, char *key);
-
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "util.h"
+#include "arena.h"
+#include "object.h"
+#include "verify.h"
+
+#define RELOCATION_ENTRY_SIZE 9UL
+#define ARENA_CHUNK_SIZE 4096UL
+
+
+typedef struct {
+    const uint8_t *data;
+    size_t size, position;
+    bool failed;
+} ObjectReader;
+
+
+typedef struct {
+    const char *name;
+    size_t length;
+} ObjectName;
+
+
+typedef struct {
+    const char *path;
+    char *content;
+    size_t content_length;
+
+    int32_t meta_vars[AMOUNT_META_VARS];
+    uint8_t meta_mask;
+    uint32_t instruction_count;
+
+    const uint8_t *code;
+    uint32_t code_size;
+
+    // Marks every offset in the code that starts an argument value, the only valid relocation targets
+    bool *value_offsets;
+
+    uint32_t amount_symbols;
+    const uint8_t *symbols;
+
+    uint32_t amount_imports;
+    ObjectName *imports;
+
+    uint32_t amount_relocations;
+    const uint8_t *relocations;
+} ObjectFile;
+
+
+static void object_error(const char *object_file, const char *message) {
+    fprintf(stderr, "\x1b[31mERROR (%s): %s\n", object_file, message);
+}
+
+
+static void symbol_error(const char *object_file, const char *message, const char *name, size_t length) {
+    fprintf(stderr, "\x1b[31mERROR (%s): %s \"%.*s\".\n", object_file, message, (int) length, name);
+}
+
+
+static const uint8_t* read_bytes(ObjectReader *reader, size_t length) {
+    if (reader->failed || reader->size - reader->position < length) {
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t *bytes = reader->data + reader->position;
+    reader->position += length;
+    return bytes;
+}
+
+
+static uint8_t read_u8(ObjectReader *reader) {
+    const uint8_t *bytes = read_bytes(reader, 1);
+    return bytes != NULL ? bytes[0] : 0;
+}
+
+
+static uint16_t read_u16(ObjectReader *reader) {
+    const uint8_t *bytes = read_bytes(reader, 2);
+    return bytes != NULL ? get_i16_big(bytes) : 0;
+}
+
+
+static uint32_t read_u32(ObjectReader *reader) {
+    const uint8_t *bytes = read_bytes(reader, 4);
+    return bytes != NULL ? get_i32_big(bytes) : 0;
+}
+
+
+static ObjectName read_name(ObjectReader *reader) {
+    ObjectName name;
+    name.length = read_u16(reader);
+    name.name = (const char*) read_bytes(reader, name.length);
+    return name;
+}
+
+
+static int write_name(FILE *file, const char *name) {
+    size_t length = strlen(name);
+    if (length > UINT16_MAX) {
+        return -1;
+    }
+    write_i16_big(file, (uint16_t) length);
+    return fwrite(name, sizeof(char), length, file) == length ? 0 : -1;
+}
+
+
+int write_object_file(const char *output_file, const ObjectContents *contents, Arena *arena) {
+    // Order imports by index
+    const char **import_names = arena_alloc(arena, (contents->imports->size + 1) * sizeof(char*));
+    if (import_names == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < contents->imports->capacity; i++) {
+        const LabelMapNode *node = &contents->imports->data[i];
+        if (node->key != NULL) {
+            import_names[node->value] = node->key;
+        }
+    }
+
+    FILE *outfile = open_output_stream(output_file);
+    if (outfile == NULL) {
+        return -1;
+    }
+
+    // Write signature and version
+    fprintf(outfile, "g1o");
+    uint8_t version = OBJECT_VERSION;
+    fwrite(&version, sizeof(uint8_t), 1, outfile);
+
+    // Write meta vars
+    for (size_t i = 0; i < AMOUNT_META_VARS; i++) {
+        write_i32_big(outfile, (uint32_t) contents->header->meta_vars[i]);
+    }
+    fwrite(&contents->meta_mask, sizeof(uint8_t), 1, outfile);
+
+    // Write code
+    write_i32_big(outfile, contents->header->instruction_count);
+    write_i32_big(outfile, (uint32_t) contents->code_size);
+    fwrite(contents->code, sizeof(uint8_t), contents->code_size, outfile);
+
+    // Write symbols
+    int error_code = 0;
+    write_i32_big(outfile, (uint32_t) contents->symbols->size);
+    for (size_t i = 0; i < contents->symbols->capacity; i++) {
+        const LabelMapNode *node = &contents->symbols->data[i];
+        if (node->key != NULL) {
+            write_i32_big(outfile, (uint32_t) node->value);
+            error_code |= write_name(outfile, node->key);
+        }
+    }
+
+    // Write imports
+    write_i32_big(outfile, (uint32_t) contents->imports->size);
+    for (size_t i = 0; i < contents->imports->size; i++) {
+        error_code |= write_name(outfile, import_names[i]);
+    }
+
+    // Write relocations
+    write_i32_big(outfile, (uint32_t) contents->relocations->size);
+    for (size_t i = 0; i < contents->relocations->size; i++) {
+        const Relocation *relocation = get_relocation_list_value(contents->relocations, i);
+        uint8_t kind = (uint8_t) relocation->kind;
+        fwrite(&kind, sizeof(uint8_t), 1, outfile);
+        write_i32_big(outfile, relocation->offset);
+        write_i32_big(outfile, relocation->import);
+    }
+
+    if (close_output_stream(outfile) != 0) {
+        return -1;
+    }
+    return error_code;
+}
+
+
+// Check that the code section holds exactly `instruction_count` valid instructions, and mark
+// where their argument values start.
+static int check_object_code(ObjectFile *object, Arena *arena) {
+    object->value_offsets = arena_calloc(arena, (size_t) object->code_size + 1, sizeof(bool));
+    if (object->value_offsets == NULL) {
+        object_error(object->path, "Failed to allocate object code.");
+        return -1;
+    }
+
+    size_t offset = 0;
+    uint8_t opcode;
+    Argument values[MAX_ARGUMENTS];
+    for (uint32_t i = 0; i < object->instruction_count; i++) {
+        size_t size = decode_instruction(&opcode, values, object->code + offset, object->code_size - offset);
+        if (size == 0 || validate_instruction(opcode, values) != -1) {
+            object_error(object->path, "Object file contains an invalid instruction.");
+            return -4;
+        }
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[opcode]; j++) {
+            object->value_offsets[offset + get_argument_value_offset(j)] = true;
+        }
+        offset += size;
+    }
+    if (offset != object->code_size) {
+        object_error(object->path, "Code section does not match the instruction count.");
+        return -4;
+    }
+    return 0;
+}
+
+
+static int read_object_file(ObjectFile *object, const char *object_file, Arena *arena) {
+    object->path = object_file;
+    object->content = NULL;
+    if (read_file_bytes(&object->content, &object->content_length, object_file, arena) != 0) {
+        object_error(object_file, "Failed to read object file.");
+        return -1;
+    }
+
+    ObjectReader reader = {(const uint8_t*) object->content, object->content_length, 0, false};
+
+    // Read signature and version
+    const uint8_t *signature = read_bytes(&reader, 3);
+    if (signature == NULL || memcmp(signature, "g1o", 3) != 0) {
+        object_error(object_file, "Not an object file.");
+        return -2;
+    }
+    if (read_u8(&reader) != OBJECT_VERSION) {
+        object_error(object_file, "Unsupported object file version.");
+        return -2;
+    }
+
+    // Read meta vars and code
+    for (size_t i = 0; i < AMOUNT_META_VARS; i++) {
+        object->meta_vars[i] = (int32_t) read_u32(&reader);
+    }
+    object->meta_mask = read_u8(&reader);
+    object->instruction_count = read_u32(&reader);
+    object->code_size = read_u32(&reader);
+    object->code = read_bytes(&reader, object->code_size);
+
+    // Skip symbols, they are read while building the symbol table
+    object->amount_symbols = read_u32(&reader);
+    object->symbols = reader.data + reader.position;
+    for (uint32_t i = 0; i < object->amount_symbols && !reader.failed; i++) {
+        read_u32(&reader);
+        read_name(&reader);
+    }
+
+    // Read imports
+    object->amount_imports = read_u32(&reader);
+    object->imports = NULL;
+    if (!reader.failed && object->amount_imports <= reader.size - reader.position) {
+        object->imports = arena_alloc(arena, (object->amount_imports + 1) * sizeof(ObjectName));
+    }
+    if (object->imports == NULL) {
+        reader.failed = true;
+    }
+    for (uint32_t i = 0; i < object->amount_imports && !reader.failed; i++) {
+        object->imports[i] = read_name(&reader);
+    }
+
+    // Read relocations
+    object->amount_relocations = read_u32(&reader);
+    if (!reader.failed && object->amount_relocations > (reader.size - reader.position) / RELOCATION_ENTRY_SIZE) {
+        reader.failed = true;
+    }
+    object->relocations = read_bytes(&reader, object->amount_relocations * RELOCATION_ENTRY_SIZE);
+
+    if (reader.failed) {
+        object_error(object_file, "Object file is truncated.");
+        return -3;
+    }
+    return check_object_code(object, arena);
+}
+
+
+static int add_object_symbols(LabelMap *symbols, const ObjectFile *object, int32_t base, Arena *arena) {
+    ObjectReader reader = {object->symbols, object->content_length - (size_t) (object->symbols - (const uint8_t*) object->content), 0, false};
+    for (uint32_t i = 0; i < object->amount_symbols; i++) {
+        uint32_t index = read_u32(&reader);
+        ObjectName name = read_name(&reader);
+
+        if (index > object->instruction_count) {
+            symbol_error(object->path, "Symbol points outside of the module", name.name, name.length);
+            return -1;
+        }
+        if (get_label_map_value(NULL, symbols, name.name, name.length) == 0) {
+            symbol_error(object->path, "Symbol defined more than once", name.name, name.length);
+            return -1;
+        }
+
+        char *key = arena_copy_string(arena, name.name, name.length);
+        if (key == NULL || add_label_map_value(symbols, key, base + (int32_t) index) != 0) {
+            object_error(object->path, "Failed to allocate symbol.");
+            return -2;
+        }
+    }
+    return 0;
+}
+
+
+static int merge_meta_vars(ImageHeader *header, const ObjectFile *objects, size_t amount_objects) {
+    for (size_t i = 0; i < AMOUNT_META_VARS; i++) {
+        const ObjectFile *setter = NULL;
+        header->meta_vars[i] = objects[0].meta_vars[i];
+        for (size_t j = 0; j < amount_objects; j++) {
+            if ((objects[j].meta_mask & (1 << i)) == 0) {
+                continue;
+            }
+            if (setter != NULL && objects[j].meta_vars[i] != setter->meta_vars[i]) {
+                symbol_error(objects[j].path, "Conflicting value for meta variable", META_VARIABLES[i], strlen(META_VARIABLES[i]));
+                return -1;
+            }
+            setter = &objects[j];
+            header->meta_vars[i] = setter->meta_vars[i];
+        }
+    }
+    return 0;
+}
+
+
+static int apply_relocations(uint8_t *code, const ObjectFile *object, int32_t base, const LabelMap *symbols) {
+    for (uint32_t i = 0; i < object->amount_relocations; i++) {
+        const uint8_t *entry = object->relocations + i * RELOCATION_ENTRY_SIZE;
+        RelocationKind kind = (RelocationKind) entry[0];
+        uint32_t offset = get_i32_big(entry + 1);
+        uint32_t import = get_i32_big(entry + 5);
+
+        if (offset >= object->code_size || !object->value_offsets[offset]) {
+            object_error(object->path, "Relocation does not point at an argument value.");
+            return -1;
+        }
+        uint8_t *value = code + offset;
+
+        if (kind == LOCAL_RELOCATION) {
+            put_i32_big(value, get_i32_big(value) + (uint32_t) base);
+        }
+        else if (kind == IMPORT_RELOCATION && import < object->amount_imports) {
+            const ObjectName *name = &object->imports[import];
+            int32_t address;
+            if (get_label_map_value(&address, symbols, name->name, name->length) != 0) {
+                symbol_error(object->path, "Undefined symbol", name->name, name->length);
+                return -1;
+            }
+            put_i32_big(value, (uint32_t) address);
+        }
+        else {
+            object_error(object->path, "Invalid relocation.");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+// Check the linked code and record which checks passed in the header's flags. Errors point at the
+// module the offending instruction came from.
+static int verify_linked_code(ImageHeader *header, const uint8_t *code, size_t code_size, const ObjectFile *objects, size_t amount_objects) {
+    VerifyResult result;
+    if (verify_image_code(&result, code, code_size, header) != 0) {
+        size_t index = result.failed_index;
+        size_t module = 0;
+        while (module + 1 < amount_objects && index >= objects[module].instruction_count) {
+            index -= objects[module].instruction_count;
+            module++;
+        }
+        fprintf(
+            stderr, "\x1b[31mERROR (%s): Instruction %zu: %s\n",
+            objects[module].path, index, get_verify_error_message(result.error)
+        );
+        return -1;
+    }
+
+    warn_unverified(&result, objects[0].path);
+    header->flags = result.flags;
+    return 0;
+}
+
+
+int link_object_files(const char *output_file, const char **object_files, size_t amount_objects, bool verify) {
+    if (amount_objects == 0) {
+        fprintf(stderr, "No object files to link.\n");
+        return -1;
+    }
+
+    Arena arena;
+    if (create_arena(&arena, ARENA_CHUNK_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize arena.\n");
+        return -1;
+    }
+
+    // Every allocation of the link comes from the arena
+    ObjectFile *objects = arena_calloc(&arena, amount_objects, sizeof(ObjectFile));
+    LabelMap symbols;
+    if (objects == NULL || create_label_map(&symbols, amount_objects * 8, &arena) != 0) {
+        fprintf(stderr, "Failed to allocate linker state.\n");
+        free_arena(&arena);
+        return -1;
+    }
+
+    int error_code = 0;
+    uint8_t *image = NULL;
+
+    // Read every object and build the global symbol table
+    size_t code_size = 0;
+    uint32_t instruction_count = 0;
+    for (size_t i = 0; i < amount_objects && error_code == 0; i++) {
+        error_code = read_object_file(&objects[i], object_files[i], &arena);
+        if (error_code == 0) {
+            error_code = add_object_symbols(&symbols, &objects[i], (int32_t) instruction_count, &arena);
+        }
+        if (error_code == 0) {
+            code_size += objects[i].code_size;
+            instruction_count += objects[i].instruction_count;
+        }
+    }
+
+    ImageHeader header;
+    header.version = verify ? VERIFIED_IMAGE_VERSION : IMAGE_VERSION;
+    header.flags = 0;
+    if (error_code == 0) {
+        error_code = merge_meta_vars(&header, objects, amount_objects);
+    }
+
+    // Concatenate code sections and patch relocations
+    size_t header_size = get_image_header_size(&header);
+    size_t image_size = header_size + code_size + IMAGE_TRAILER_SIZE;
+    if (error_code == 0) {
+        image = arena_alloc(&arena, image_size);
+        if (image == NULL) {
+            fprintf(stderr, "Failed to allocate output image.\n");
+            error_code = -1;
+        }
+    }
+
+    size_t code_offset = header_size;
+    int32_t base = 0;
+    for (size_t i = 0; i < amount_objects && error_code == 0; i++) {
+        memcpy(image + code_offset, objects[i].code, objects[i].code_size);
+        error_code = apply_relocations(image + code_offset, &objects[i], base, &symbols);
+        code_offset += objects[i].code_size;
+        base += (int32_t) objects[i].instruction_count;
+    }
+
+    if (error_code == 0) {
+        header.start_label = -1;
+        header.tick_label = -1;
+        header.instruction_count = instruction_count;
+        get_label_map_value(&header.start_label, &symbols, "start", 5);
+        get_label_map_value(&header.tick_label, &symbols, "tick", 4);
+        if (verify) {
+            error_code = verify_linked_code(&header, image + header_size, code_size, objects, amount_objects);
+        }
+    }
+
+    if (error_code == 0) {
+        put_image_header(image, image_size, &header);
+        if (write_image_file(output_file, image, image_size) != 0) {
+            fprintf(stderr, "Failed to write output file.\n");
+            error_code = -1;
+        }
+    }
+
+    free_arena(&arena);
+
+    return error_code;
+}
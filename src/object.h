@@ -0,0 +1,77 @@
+#ifndef G1_OBJECT_H
+#define G1_OBJECT_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "list.h"
+#include "image.h"
+#include "instruction.h"
+
+
+/*
+ * Object file layout (all fixed-width integers are big endian):
+ *
+ *   "g1o"                       signature
+ *   u8   version                currently 1
+ *   i32  meta vars              memory, width, height, tickrate
+ *   u8   meta var mask          bit i is set if meta var i was set explicitly
+ *   u32  instruction count
+ *   u32  code size              followed by the encoded instructions, laid out
+ *                               exactly as in an image
+ *   u32  symbol count           followed by (u32 instruction index, u16 length, bytes)
+ *                               for every label the module defines
+ *   u32  import count           followed by (u16 length, bytes) for every label
+ *                               the module references but does not define
+ *   u32  relocation count       followed by (u8 kind, u32 code offset, u32 import index)
+ *                               for every label argument; the offset points at the
+ *                               argument's 32 bit value
+ *
+ * A local relocation holds a module-relative instruction index that the linker
+ * offsets by the module's position. An import relocation holds 0 and is replaced
+ * with the address of the named symbol.
+ */
+
+
+#define OBJECT_VERSION 1
+
+
+typedef enum {
+    LOCAL_RELOCATION,
+    IMPORT_RELOCATION
+} RelocationKind;
+
+
+typedef struct {
+    RelocationKind kind;
+    uint32_t offset, import;
+} Relocation;
+
+
+DEFINE_TYPED_LIST(RelocationList, relocation_list, Relocation)
+
+
+typedef struct {
+    const ImageHeader *header;
+    uint8_t meta_mask;
+
+    const uint8_t *code;
+    size_t code_size;
+
+    const LabelMap *symbols;
+    const LabelMap *imports;
+    const RelocationList *relocations;
+} ObjectContents;
+
+
+// Write a relocatable object to `output_file`, or to stdout if it is "-". Scratch memory comes
+// from `arena`.
+int write_object_file(const char *output_file, const ObjectContents *contents, Arena *arena);
+
+// Link `amount_objects` object files into an image at `output_file`. With `verify`, the linked
+// code is checked and written as a version 2 image, like `AssemblerOptions.verify`.
+int link_object_files(const char *output_file, const char **object_files, size_t amount_objects, bool verify);
+
+
+#endif
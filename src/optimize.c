@@ -0,0 +1,726 @@
+#include <string.h>
+#include "optimize.h"
+
+
+static bool is_literal_instruction(const Instruction *ins) {
+    for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+        if (ins->values[j].type != LITERAL_ARG || ins->values[j].reference != NO_REFERENCE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Returns whether `arg` is a jump target that points into this module.
+static bool is_local_jump_target(const Argument *arg) {
+    return arg->type == LITERAL_ARG && arg->reference != IMPORT_REFERENCE;
+}
+
+
+static size_t get_program_size(const InstructionList *instructions) {
+    size_t size = 0;
+    for (size_t i = 0; i < instructions->size; i++) {
+        size += get_instruction_size(instructions->data[i].opcode);
+    }
+    return size;
+}
+
+
+// Replace `ins` with an instruction whose arguments are all literals.
+static void set_literal_instruction(Instruction *ins, uint8_t opcode, const int32_t *values) {
+    ins->opcode = opcode;
+    for (uint8_t j = 0; j < ARGUMENT_COUNTS[opcode]; j++) {
+        ins->values[j].type = LITERAL_ARG;
+        ins->values[j].value = values[j];
+        ins->values[j].reference = NO_REFERENCE;
+    }
+    // Keep diagnostics pointing at the original instruction
+    for (uint8_t j = 0; j < MAX_ARGUMENTS; j++) {
+        ins->arguments[j] = ins->token;
+    }
+}
+
+
+bool has_static_control_flow(const InstructionList *instructions) {
+    for (size_t i = 0; i < instructions->size; i++) {
+        const Instruction *ins = &instructions->data[i];
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+            bool is_jump_target = ins->opcode == JMP_OP && j == 0;
+            if (is_jump_target && ins->values[j].type != LITERAL_ARG) {
+                return false;
+            }
+            // A label used as a value could be stored and jumped to, or be observed by the program
+            if (!is_jump_target && ins->values[j].reference == LABEL_REFERENCE) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+// Mark every instruction that can be reached other than by falling through. `leaders` has room
+// for one entry per instruction and one more.
+static void find_leaders(bool *leaders, const InstructionList *instructions, const LabelMap *labels) {
+    size_t amount = instructions->size;
+    memset(leaders, 0, (amount + 1) * sizeof(bool));
+
+    for (size_t i = 0; i < labels->capacity; i++) {
+        const LabelMapNode *node = &labels->data[i];
+        if (node->key != NULL && node->value >= 0 && (size_t) node->value <= amount) {
+            leaders[node->value] = true;
+        }
+    }
+
+    for (size_t i = 0; i < amount; i++) {
+        const Instruction *ins = &instructions->data[i];
+        if (ins->opcode != JMP_OP) {
+            continue;
+        }
+        leaders[i + 1] = true;
+        int32_t target = ins->values[0].value;
+        if (is_local_jump_target(&ins->values[0]) && target >= 0 && (size_t) target <= amount) {
+            leaders[target] = true;
+        }
+    }
+}
+
+
+// Returns whether argument `j` of `ins` holds the index of an instruction in this module.
+static bool is_code_address(const Instruction *ins, uint8_t j) {
+    const Argument *arg = &ins->values[j];
+    return arg->reference == LABEL_REFERENCE || (ins->opcode == JMP_OP && j == 0 && is_local_jump_target(arg));
+}
+
+
+// Replace every label and code address `i` of the kept instructions with `mapping[i]`.
+static void remap_code_addresses(InstructionList *instructions, LabelMap *labels, const int32_t *mapping, const bool *keep) {
+    size_t amount = instructions->size;
+    for (size_t i = 0; i < labels->capacity; i++) {
+        LabelMapNode *node = &labels->data[i];
+        if (node->key != NULL && node->value >= 0 && (size_t) node->value <= amount) {
+            node->value = mapping[node->value];
+        }
+    }
+
+    for (size_t i = 0; i < amount; i++) {
+        Instruction *ins = &instructions->data[i];
+        if (!keep[i]) {
+            continue;
+        }
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+            Argument *arg = &ins->values[j];
+            if (is_code_address(ins, j) && arg->value >= 0 && (size_t) arg->value <= amount) {
+                arg->value = mapping[arg->value];
+            }
+        }
+    }
+}
+
+
+// Remove every instruction whose `keep` entry is false, using `new_indices` as scratch space
+// with room for one entry per instruction and one more.
+static void compact_with_indices(InstructionList *instructions, LabelMap *labels, const bool *keep, int32_t *new_indices) {
+    size_t amount = instructions->size;
+
+    // A removed instruction maps to the next kept one
+    int32_t kept = 0;
+    for (size_t i = 0; i < amount; i++) {
+        new_indices[i] = kept;
+        if (keep[i]) {
+            kept++;
+        }
+    }
+    new_indices[amount] = kept;
+
+    remap_code_addresses(instructions, labels, new_indices, keep);
+
+    size_t dest = 0;
+    for (size_t i = 0; i < amount; i++) {
+        if (keep[i]) {
+            instructions->data[dest++] = instructions->data[i];
+        }
+    }
+    instructions->size = dest;
+}
+
+
+int compact_instructions(InstructionList *instructions, LabelMap *labels, const bool *keep, Arena *arena) {
+    int32_t *new_indices = arena_alloc(arena, (instructions->size + 1) * sizeof(int32_t));
+    if (new_indices == NULL) {
+        return -1;
+    }
+    compact_with_indices(instructions, labels, keep, new_indices);
+    return 0;
+}
+
+
+// Drop colors that are already active, fold single pixel shapes into points and one pixel wide
+// or tall rects into lines.
+static void fold_draw_calls(InstructionList *instructions, const bool *leaders, bool *keep) {
+    bool color_known = false;
+    int32_t color[3];
+    for (size_t i = 0; i < instructions->size; i++) {
+        Instruction *ins = &instructions->data[i];
+        if (leaders[i]) {
+            color_known = false;
+        }
+
+        bool literal = is_literal_instruction(ins);
+        int32_t v[MAX_ARGUMENTS];
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+            v[j] = ins->values[j].value;
+        }
+
+        switch (ins->opcode) {
+            case COLOR_OP:
+                if (!literal) {
+                    color_known = false;
+                }
+                else if (color_known && memcmp(color, v, sizeof(color)) == 0) {
+                    keep[i] = false;
+                }
+                else {
+                    memcpy(color, v, sizeof(color));
+                    color_known = true;
+                }
+                break;
+            case LINE_OP:
+                if (literal && v[0] == v[2] && v[1] == v[3]) {
+                    set_literal_instruction(ins, POINT_OP, v);
+                }
+                break;
+            case RECT_OP:
+                if (literal && v[2] == 1 && v[3] == 1) {
+                    set_literal_instruction(ins, POINT_OP, v);
+                }
+                else if (literal && (v[2] == 1 || v[3] == 1) && v[2] >= 1 && v[3] >= 1) {
+                    // A one pixel wide or tall rect is a line, unless its far corner overflows
+                    int64_t end_x = (int64_t) v[0] + v[2] - 1;
+                    int64_t end_y = (int64_t) v[1] + v[3] - 1;
+                    if (end_x <= INT32_MAX && end_y <= INT32_MAX) {
+                        int32_t line[4] = {v[0], v[1], (int32_t) end_x, (int32_t) end_y};
+                        set_literal_instruction(ins, LINE_OP, line);
+                    }
+                }
+                break;
+        }
+    }
+}
+
+
+// Merge runs of literal points that step one pixel along an axis into lines.
+static void merge_point_runs(InstructionList *instructions, const bool *leaders, bool *keep) {
+    size_t amount = instructions->size;
+    size_t i = 0;
+    while (i < amount) {
+        Instruction *first = &instructions->data[i];
+        if (!keep[i] || first->opcode != POINT_OP || !is_literal_instruction(first)) {
+            i++;
+            continue;
+        }
+
+        // Coordinates far apart can differ by more than an int32 holds
+        int64_t end[2] = {first->values[0].value, first->values[1].value};
+        int64_t step[2] = {0, 0};
+        size_t length = 1;
+
+        size_t j = i + 1;
+        while (j < amount) {
+            // Skip removed instructions, but never cross a leader
+            bool crosses_leader = false;
+            while (j < amount && !keep[j]) {
+                crosses_leader |= leaders[j];
+                j++;
+            }
+            if (j >= amount || crosses_leader || leaders[j]) {
+                break;
+            }
+
+            Instruction *ins = &instructions->data[j];
+            if (ins->opcode != POINT_OP || !is_literal_instruction(ins)) {
+                break;
+            }
+            int64_t dx = (int64_t) ins->values[0].value - end[0];
+            int64_t dy = (int64_t) ins->values[1].value - end[1];
+
+            if (dx == 0 && dy == 0) {
+                // Drawing the same pixel again changes nothing
+                keep[j] = false;
+                j++;
+                continue;
+            }
+
+            bool is_unit_step = (dx == 0 && (dy == 1 || dy == -1)) || (dy == 0 && (dx == 1 || dx == -1));
+            bool matches_step = length == 1 || (dx == step[0] && dy == step[1]);
+            if (!is_unit_step || !matches_step) {
+                break;
+            }
+
+            step[0] = dx;
+            step[1] = dy;
+            end[0] += dx;
+            end[1] += dy;
+            keep[j] = false;
+            length++;
+            j++;
+        }
+
+        if (length > 1) {
+            int32_t line[4] = {first->values[0].value, first->values[1].value, (int32_t) end[0], (int32_t) end[1]};
+            set_literal_instruction(first, LINE_OP, line);
+        }
+        i = j;
+    }
+}
+
+
+int coalesce_draw_calls(InstructionList *instructions, LabelMap *labels, OptimizationStats *stats, Arena *arena) {
+    if (!has_static_control_flow(instructions)) {
+        return 0;
+    }
+
+    bool *leaders = arena_alloc(arena, (instructions->size + 1) * sizeof(bool));
+    bool *keep = arena_alloc(arena, (instructions->size + 1) * sizeof(bool));
+    if (leaders == NULL || keep == NULL) {
+        return -1;
+    }
+    find_leaders(leaders, instructions, labels);
+    for (size_t i = 0; i < instructions->size; i++) {
+        keep[i] = true;
+    }
+
+    size_t old_amount = instructions->size;
+    size_t old_size = get_program_size(instructions);
+
+    fold_draw_calls(instructions, leaders, keep);
+    merge_point_runs(instructions, leaders, keep);
+    if (compact_instructions(instructions, labels, keep, arena) != 0) {
+        return -1;
+    }
+
+    stats->removed_instructions += old_amount - instructions->size;
+    stats->saved_bytes += old_size - get_program_size(instructions);
+    return 0;
+}
+
+
+typedef struct {
+    size_t start, end;
+
+    // Instructions before `body_end` make up the block, the rest is its final unconditional jump
+    size_t body_end;
+
+    // Where control goes after the block, with local targets stored as plain literals
+    Argument exit;
+} BasicBlock;
+
+
+// Scratch space for the folding passes, sized for the program before folding. The program only
+// shrinks, so every pass can reuse it.
+typedef struct {
+    // Start of every label region, and one entry for the end of the program
+    size_t *starts;
+
+    // Open addressing tables of region or block indices, SIZE_MAX marks a free slot
+    size_t *label_table, *block_table;
+    size_t label_mask, block_mask;
+
+    int32_t *redirects;
+    bool *keep, *leaders;
+    BasicBlock *blocks;
+} FoldScratch;
+
+
+static bool is_unconditional_jump(const Instruction *ins) {
+    return ins->opcode == JMP_OP && ins->values[1].type == LITERAL_ARG && ins->values[1].value != 0;
+}
+
+
+static bool arguments_equal(const Argument *a, const Argument *b) {
+    return a->type == b->type && a->value == b->value && a->reference == b->reference;
+}
+
+
+static bool instructions_equal(const Instruction *a, const Instruction *b) {
+    if (a->opcode != b->opcode) {
+        return false;
+    }
+    for (uint8_t j = 0; j < ARGUMENT_COUNTS[a->opcode]; j++) {
+        if (!arguments_equal(&a->values[j], &b->values[j])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static inline size_t hash_word(size_t hash, uint32_t word) {
+    return (hash ^ word) * FNV_PRIME;
+}
+
+
+static size_t hash_argument(size_t hash, const Argument *arg) {
+    hash = hash_word(hash, arg->type);
+    hash = hash_word(hash, (uint32_t) arg->value);
+    return hash_word(hash, arg->reference);
+}
+
+
+static size_t hash_instruction(size_t hash, const Instruction *ins) {
+    hash = hash_word(hash, ins->opcode);
+    for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+        hash = hash_argument(hash, &ins->values[j]);
+    }
+    return hash;
+}
+
+
+// Replace `ins` with an unconditional jump to instruction `target`.
+static void set_jump_instruction(Instruction *ins, size_t target) {
+    int32_t values[2] = {(int32_t) target, 1};
+    set_literal_instruction(ins, JMP_OP, values);
+    // Object files relocate the target like a label
+    ins->values[0].reference = LABEL_REFERENCE;
+}
+
+
+// Returns whether control can reach instruction `index` by falling through.
+static bool is_fallen_into(const InstructionList *instructions, size_t index) {
+    return index == 0 || !is_unconditional_jump(&instructions->data[index - 1]);
+}
+
+
+// Returns the size of the instructions in [start, end).
+static size_t get_range_size(const InstructionList *instructions, size_t start, size_t end) {
+    size_t size = 0;
+    for (size_t i = start; i < end; i++) {
+        size += get_instruction_size(instructions->data[i].opcode);
+    }
+    return size;
+}
+
+
+// Lets a table of `amount` entries stay at most half full. Returns the mask of a power of two size.
+static size_t get_table_mask(size_t amount) {
+    size_t size = 2;
+    while (size < amount * 2) {
+        size *= 2;
+    }
+    return size - 1;
+}
+
+
+// Remove the instructions in [start, end) that duplicate the code at `target`. Everything that
+// pointed into the range is redirected to the copy. If control can fall into the range, a jump to
+// the copy stays behind, which only pays off when the range is larger than the jump.
+// Returns whether the range was replaced.
+static bool replace_with_copy(
+        InstructionList *instructions, size_t start, size_t end, size_t target,
+        bool redirect_range, int32_t *redirects, bool *keep
+    ) {
+    size_t first_removed = start;
+    if (is_fallen_into(instructions, start)) {
+        if (get_range_size(instructions, start, end) <= get_instruction_size(JMP_OP)) {
+            return false;
+        }
+        set_jump_instruction(&instructions->data[start], target);
+        first_removed = start + 1;
+    }
+    for (size_t i = first_removed; i < end; i++) {
+        keep[i] = false;
+    }
+
+    size_t redirected = redirect_range ? end - start : 1;
+    for (size_t i = 0; i < redirected; i++) {
+        redirects[start + i] = (int32_t) (target + i);
+    }
+    return true;
+}
+
+
+// Apply the redirects and remove instructions. The redirects are reused as scratch space.
+static void rewrite_instructions(InstructionList *instructions, LabelMap *labels, int32_t *redirects, const bool *keep) {
+    remap_code_addresses(instructions, labels, redirects, keep);
+    compact_with_indices(instructions, labels, keep, redirects);
+}
+
+
+// Compare argument `j` of two instructions, where code addresses inside their regions are
+// compared relative to the region start.
+static bool region_arguments_equal(
+        const Instruction *a, size_t a_start, size_t a_end,
+        const Instruction *b, size_t b_start, size_t b_end, uint8_t j
+    ) {
+    Argument a_value = a->values[j], b_value = b->values[j];
+    if (is_code_address(a, j) && is_code_address(b, j)) {
+        bool a_inside = a_value.value >= 0 && (size_t) a_value.value >= a_start && (size_t) a_value.value < a_end;
+        bool b_inside = b_value.value >= 0 && (size_t) b_value.value >= b_start && (size_t) b_value.value < b_end;
+        if (a_inside != b_inside) {
+            return false;
+        }
+        if (a_inside) {
+            a_value.value -= (int32_t) a_start;
+            b_value.value -= (int32_t) b_start;
+        }
+    }
+    return arguments_equal(&a_value, &b_value);
+}
+
+
+static bool regions_equal(const InstructionList *instructions, size_t a_start, size_t a_end, size_t b_start, size_t b_end) {
+    if (a_end - a_start != b_end - b_start) {
+        return false;
+    }
+    for (size_t i = 0; i < a_end - a_start; i++) {
+        const Instruction *a = &instructions->data[a_start + i];
+        const Instruction *b = &instructions->data[b_start + i];
+        if (a->opcode != b->opcode) {
+            return false;
+        }
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[a->opcode]; j++) {
+            if (!region_arguments_equal(a, a_start, a_end, b, b_start, b_end, j)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+static size_t hash_region(const InstructionList *instructions, size_t start, size_t end) {
+    size_t hash = FNV_OFFSET;
+    for (size_t i = start; i < end; i++) {
+        const Instruction *ins = &instructions->data[i];
+        hash = hash_word(hash, ins->opcode);
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+            Argument arg = ins->values[j];
+            bool inside = is_code_address(ins, j) && arg.value >= 0 && (size_t) arg.value >= start && (size_t) arg.value < end;
+            if (inside) {
+                arg.value -= (int32_t) start;
+            }
+            hash = hash_word(hash_argument(hash, &arg), inside);
+        }
+    }
+    return hash;
+}
+
+
+static int compare_sizes(const void *a, const void *b) {
+    size_t x = *(const size_t*) a, y = *(const size_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+// Merge identical regions between consecutive labels that end in an unconditional jump.
+// Returns the amount of merged regions.
+static size_t fold_label_regions(InstructionList *instructions, LabelMap *labels, FoldScratch *scratch) {
+    size_t amount = instructions->size;
+    size_t *starts = scratch->starts;
+    int32_t *redirects = scratch->redirects;
+    bool *keep = scratch->keep;
+    size_t mask = scratch->label_mask;
+    size_t *table = scratch->label_table;
+
+    size_t amount_starts = 0;
+    for (size_t i = 0; i < labels->capacity; i++) {
+        const LabelMapNode *node = &labels->data[i];
+        if (node->key != NULL && node->value >= 0 && (size_t) node->value < amount) {
+            starts[amount_starts++] = (size_t) node->value;
+        }
+    }
+    qsort(starts, amount_starts, sizeof(size_t), compare_sizes);
+    starts[amount_starts] = amount;
+
+    for (size_t i = 0; i <= amount; i++) {
+        redirects[i] = (int32_t) i;
+        keep[i] = true;
+    }
+    for (size_t i = 0; i <= mask; i++) {
+        table[i] = SIZE_MAX;
+    }
+
+    size_t merged = 0;
+    for (size_t r = 0; r < amount_starts; r++) {
+        size_t start = starts[r], end = starts[r + 1];
+        if (start == end || !is_unconditional_jump(&instructions->data[end - 1])) {
+            continue;
+        }
+
+        size_t slot = hash_region(instructions, start, end) & mask;
+        while (table[slot] != SIZE_MAX) {
+            size_t copy = table[slot];
+            size_t copy_end = starts[copy + 1];
+            if (regions_equal(instructions, starts[copy], copy_end, start, end)) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot] == SIZE_MAX) {
+            table[slot] = r;
+            continue;
+        }
+        if (replace_with_copy(instructions, start, end, starts[table[slot]], true, redirects, keep)) {
+            merged++;
+        }
+    }
+
+    if (merged > 0) {
+        rewrite_instructions(instructions, labels, redirects, keep);
+    }
+    return merged;
+}
+
+
+static void find_blocks(BasicBlock *blocks, size_t *amount_blocks, const InstructionList *instructions, const bool *leaders) {
+    size_t amount = instructions->size;
+    *amount_blocks = 0;
+    for (size_t start = 0; start < amount;) {
+        size_t end = start + 1;
+        while (end < amount && !leaders[end]) {
+            end++;
+        }
+
+        BasicBlock *block = &blocks[(*amount_blocks)++];
+        block->start = start;
+        block->end = end;
+        const Instruction *last = &instructions->data[end - 1];
+        if (is_unconditional_jump(last)) {
+            block->body_end = end - 1;
+            block->exit = last->values[0];
+            if (is_local_jump_target(&block->exit)) {
+                block->exit.reference = NO_REFERENCE;
+            }
+        }
+        else {
+            block->body_end = end;
+            block->exit = (Argument) {LITERAL_ARG, (int32_t) end, NO_REFERENCE};
+        }
+        start = end;
+    }
+}
+
+
+// Let `block` jump into the longest tail it shares with `copy`. Returns whether it changed.
+static bool share_block_tail(InstructionList *instructions, const BasicBlock *copy, const BasicBlock *block, int32_t *redirects, bool *keep) {
+    size_t length = 0;
+    size_t max_length = block->body_end - block->start;
+    if (copy->body_end - copy->start < max_length) {
+        max_length = copy->body_end - copy->start;
+    }
+    while (length < max_length && instructions_equal(
+            &instructions->data[copy->body_end - length - 1],
+            &instructions->data[block->body_end - length - 1]
+        )) {
+        length++;
+    }
+
+    size_t tail = block->body_end - length;
+    size_t target = copy->body_end - length;
+    if (tail == block->start) {
+        return replace_with_copy(instructions, tail, block->end, target, false, redirects, keep);
+    }
+
+    // The tail follows the rest of the block, so it always needs a jump
+    if (get_range_size(instructions, tail, block->end) <= get_instruction_size(JMP_OP)) {
+        return false;
+    }
+    set_jump_instruction(&instructions->data[tail], target);
+    for (size_t i = tail + 1; i < block->end; i++) {
+        keep[i] = false;
+    }
+    return true;
+}
+
+
+// Cross jump between basic blocks that leave the same way and end in the same instruction.
+// Returns the amount of changed blocks.
+static size_t fold_block_tails(InstructionList *instructions, LabelMap *labels, FoldScratch *scratch) {
+    size_t amount = instructions->size;
+    bool *leaders = scratch->leaders;
+    BasicBlock *blocks = scratch->blocks;
+    int32_t *redirects = scratch->redirects;
+    bool *keep = scratch->keep;
+    size_t mask = scratch->block_mask;
+    size_t *table = scratch->block_table;
+
+    find_leaders(leaders, instructions, labels);
+    size_t amount_blocks;
+    find_blocks(blocks, &amount_blocks, instructions, leaders);
+    for (size_t i = 0; i <= amount; i++) {
+        redirects[i] = (int32_t) i;
+        keep[i] = true;
+    }
+    for (size_t i = 0; i <= mask; i++) {
+        table[i] = SIZE_MAX;
+    }
+
+    // The first block with a given exit and last instruction is the copy the others jump into
+    size_t changed = 0;
+    for (size_t b = 0; b < amount_blocks; b++) {
+        const BasicBlock *block = &blocks[b];
+        if (block->body_end == block->start) {
+            continue;
+        }
+        const Instruction *last = &instructions->data[block->body_end - 1];
+
+        size_t slot = hash_instruction(hash_argument(FNV_OFFSET, &block->exit), last) & mask;
+        while (table[slot] != SIZE_MAX) {
+            const BasicBlock *copy = &blocks[table[slot]];
+            if (arguments_equal(&copy->exit, &block->exit) && instructions_equal(&instructions->data[copy->body_end - 1], last)) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot] == SIZE_MAX) {
+            table[slot] = b;
+            continue;
+        }
+        if (share_block_tail(instructions, &blocks[table[slot]], block, redirects, keep)) {
+            changed++;
+        }
+    }
+
+    if (changed > 0) {
+        rewrite_instructions(instructions, labels, redirects, keep);
+    }
+    return changed;
+}
+
+
+int fold_identical_code(InstructionList *instructions, LabelMap *labels, OptimizationStats *stats, Arena *arena) {
+    if (!has_static_control_flow(instructions)) {
+        return 0;
+    }
+
+    size_t old_amount = instructions->size;
+    size_t old_size = get_program_size(instructions);
+
+    FoldScratch scratch;
+    scratch.label_mask = get_table_mask(labels->size + 1);
+    scratch.block_mask = get_table_mask(old_amount + 1);
+    scratch.starts = arena_alloc(arena, (labels->size + 1) * sizeof(size_t));
+    scratch.label_table = arena_alloc(arena, (scratch.label_mask + 1) * sizeof(size_t));
+    scratch.block_table = arena_alloc(arena, (scratch.block_mask + 1) * sizeof(size_t));
+    scratch.redirects = arena_alloc(arena, (old_amount + 1) * sizeof(int32_t));
+    scratch.keep = arena_alloc(arena, (old_amount + 1) * sizeof(bool));
+    scratch.leaders = arena_alloc(arena, (old_amount + 1) * sizeof(bool));
+    scratch.blocks = arena_alloc(arena, (old_amount + 1) * sizeof(BasicBlock));
+    if (!scratch.starts || !scratch.label_table || !scratch.block_table || !scratch.redirects || !scratch.keep || !scratch.leaders || !scratch.blocks) {
+        return -1;
+    }
+
+    // Every merge shrinks the program, so both loops end
+    size_t merged;
+    do {
+        merged = fold_label_regions(instructions, labels, &scratch);
+    } while (merged > 0);
+    do {
+        merged = fold_block_tails(instructions, labels, &scratch);
+    } while (merged > 0);
+
+    stats->removed_instructions += old_amount - instructions->size;
+    stats->saved_bytes += old_size - get_program_size(instructions);
+    return 0;
+}
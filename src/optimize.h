@@ -0,0 +1,40 @@
+#ifndef G1_OPTIMIZE_H
+#define G1_OPTIMIZE_H
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "instruction.h"
+#include "arena.h"
+
+
+typedef struct {
+    size_t removed_instructions, saved_bytes;
+} OptimizationStats;
+
+
+// Returns whether every jump target in the program is a literal or a label known at assembly time,
+// and labels are not used as values anywhere else. Only then can a pass move code and update
+// every address that points into it.
+bool has_static_control_flow(const InstructionList *instructions);
+
+// Remove every instruction whose `keep` entry is false. Labels and jump targets that pointed at
+// a removed instruction move to the next kept one. Scratch memory comes from `arena`, as it does
+// for the passes below.
+int compact_instructions(InstructionList *instructions, LabelMap *labels, const bool *keep, Arena *arena);
+
+// Remove `color` instructions that set the color that is already active, fold single pixel
+// `line` and `rect` instructions into `point` and one pixel wide or tall `rect`s into `line`, and
+// merge runs of adjacent literal points into `line`.
+// Assumes `line` draws both of its endpoints and `rect x y w h` covers w by h pixels from (x, y).
+// Does nothing unless every jump target is known at assembly time.
+int coalesce_draw_calls(InstructionList *instructions, LabelMap *labels, OptimizationStats *stats, Arena *arena);
+
+// Merge identical regions between labels, such as copies of a subroutine, and let basic blocks that
+// leave the same way share their common tail by jumping into one copy of it. Labels and jumps into
+// removed code are redirected to the copy. Does nothing unless every jump target is known at
+// assembly time.
+int fold_identical_code(InstructionList *instructions, LabelMap *labels, OptimizationStats *stats, Arena *arena);
+
+
+#endif
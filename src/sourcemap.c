@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "sourcemap.h"
+
+
+static int write_varint(FILE *file, uint32_t value) {
+    uint8_t bytes[5];
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        bytes[length++] = byte;
+    } while (value != 0);
+    return fwrite(bytes, sizeof(uint8_t), length, file) == length ? 0 : -1;
+}
+
+
+static uint32_t zigzag(int64_t value) {
+    return (uint32_t) (((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+
+static int compare_label_entries(const void *a, const void *b) {
+    const SourceMapLabel *entry_a = a, *entry_b = b;
+    if (entry_a->index != entry_b->index) {
+        return entry_a->index < entry_b->index ? -1 : 1;
+    }
+    return strcmp(entry_a->name, entry_b->name);
+}
+
+
+static int write_string(FILE *file, const char *s) {
+    size_t length = strlen(s);
+    if (length > UINT16_MAX) {
+        length = UINT16_MAX;
+    }
+    write_i16_big(file, (uint16_t) length);
+    return fwrite(s, sizeof(char), length, file) == length ? 0 : -1;
+}
+
+
+int write_source_map(
+        const char *output_file, const char *source_file,
+        const SourceLocation *locations, size_t amount_locations,
+        SourceMapLabel *labels, size_t amount_labels
+    ) {
+    FILE *outfile = open_output_stream(output_file);
+    if (outfile == NULL) {
+        return -1;
+    }
+
+    // Write signature and version
+    fprintf(outfile, "g1sm");
+    uint8_t version = SOURCE_MAP_VERSION;
+    fwrite(&version, sizeof(uint8_t), 1, outfile);
+
+    // Write file table
+    write_i16_big(outfile, 1);
+    write_string(outfile, source_file);
+
+    // Write delta-encoded locations
+    write_i32_big(outfile, (uint32_t) amount_locations);
+    SourceLocation previous = {0, 0, 0};
+    for (size_t i = 0; i < amount_locations; i++) {
+        const SourceLocation *location = &locations[i];
+        write_varint(outfile, location->file);
+        write_varint(outfile, zigzag((int64_t) location->line - previous.line));
+        write_varint(outfile, zigzag((int64_t) location->column - previous.column));
+        previous = *location;
+    }
+
+    // Write label table, sorted by instruction index
+    qsort(labels, amount_labels, sizeof(SourceMapLabel), compare_label_entries);
+    write_i32_big(outfile, (uint32_t) amount_labels);
+    for (size_t i = 0; i < amount_labels; i++) {
+        write_i32_big(outfile, (uint32_t) labels[i].index);
+        write_string(outfile, labels[i].name);
+    }
+
+    return close_output_stream(outfile);
+}
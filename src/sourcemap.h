@@ -0,0 +1,49 @@
+#ifndef G1_SOURCEMAP_H
+#define G1_SOURCEMAP_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/*
+ * Source map layout (all fixed-width integers are big endian):
+ *
+ *   "g1sm"                      signature
+ *   u8   version                currently 1
+ *   u16  file count             followed by (u16 length, bytes) per file
+ *   u32  entry count            one entry per instruction, in instruction order
+ *   entries                     varint file index, zigzag varint line delta,
+ *                               zigzag varint column delta (relative to the
+ *                               previous entry, starting from 0)
+ *   u32  label count            followed by (u32 instruction index, u16 length, bytes)
+ *                               per label, sorted by instruction index
+ *
+ * Lines and columns are 1-based.
+ */
+
+
+#define SOURCE_MAP_VERSION 1
+
+
+typedef struct {
+    uint32_t file, line, column;
+} SourceLocation;
+
+
+typedef struct {
+    const char *name;
+    int32_t index;
+} SourceMapLabel;
+
+
+// Write a source map for `amount_locations` instructions to `output_file`.
+// `labels` is sorted in place by instruction index.
+int write_source_map(
+    const char *output_file, const char *source_file,
+    const SourceLocation *locations, size_t amount_locations,
+    SourceMapLabel *labels, size_t amount_labels
+);
+
+
+#endif
@@ -2,13 +2,17 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/stat.h>
+#include "util.h"
+
+#define STREAM_CHUNK_SIZE 65536UL
 
 
 // Based on https://stackoverflow.com/a/3464656
 // Reads data from `file_path` into `output_buffer` and stores the length in `length`.
-int read_file_bytes(char **output_buffer, size_t *length, const char *file_path) {
-    if (!output_buffer || !length || !file_path) {
+int read_file_bytes(char **output_buffer, size_t *length, const char *file_path, Arena *arena) {
+    if (!output_buffer || !length || !file_path || !arena) {
         return -1;  // Invalid arguments
     }
 
@@ -29,7 +33,7 @@ int read_file_bytes(char **output_buffer, size_t *length, const char *file_path)
     }
     rewind(handler);
 
-    char *buffer = malloc((size_t) file_size + 1);
+    char *buffer = arena_alloc(arena, (size_t) file_size + 1);
     if (!buffer) {
         fclose(handler);
         return -5;  // Memory allocation failure
@@ -37,7 +41,6 @@ int read_file_bytes(char **output_buffer, size_t *length, const char *file_path)
 
     size_t read_size = fread(buffer, sizeof (char), (size_t) file_size, handler);
     if (read_size != (size_t) file_size) {
-        free(buffer);
         fclose(handler);
         return -6;  // Read error
     }
@@ -52,12 +55,73 @@ int read_file_bytes(char **output_buffer, size_t *length, const char *file_path)
 }
 
 
+// Reads `stream` until EOF into `output_buffer` and stores the length in `length`.
+int read_stream_bytes(char **output_buffer, size_t *length, FILE *stream, Arena *arena) {
+    if (!output_buffer || !length || !stream || !arena) {
+        return -1;  // Invalid arguments
+    }
+
+    size_t capacity = STREAM_CHUNK_SIZE;
+    size_t size = 0;
+    char *buffer = arena_alloc(arena, capacity + 1);
+    if (!buffer) {
+        return -5;  // Memory allocation failure
+    }
+
+    while (true) {
+        size_t read_size = fread(buffer + size, sizeof (char), capacity - size, stream);
+        size += read_size;
+        if (size < capacity) {
+            if (ferror(stream)) {
+                return -6;  // Read error
+            }
+            if (feof(stream)) {
+                break;
+            }
+            continue;
+        }
+
+        // The smaller buffer stays in the arena, which is fine as the buffer doubles each time
+        capacity *= 2;
+        char *new_buffer = arena_alloc(arena, capacity + 1);
+        if (!new_buffer) {
+            return -5;  // Memory allocation failure
+        }
+        memcpy(new_buffer, buffer, size);
+        buffer = new_buffer;
+    }
+
+    buffer[size] = '\0';
+
+    *output_buffer = buffer;
+    *length = size;
+
+    return 0;  // Success
+}
+
+
 bool file_exists(char* path) {
     struct stat buffer;
     return stat(path, &buffer) == 0;
 }
 
 
+FILE* open_output_stream(const char *path) {
+    if (strcmp(path, STDIO_PATH) == 0) {
+        return stdout;
+    }
+    return fopen(path, "wb");
+}
+
+
+int close_output_stream(FILE *stream) {
+    if (stream == stdout) {
+        return fflush(stream) == 0 ? 0 : -1;
+    }
+    return fclose(stream) == 0 ? 0 : -1;
+}
+
+
 static uint16_t host_to_big_16(uint16_t host_16bits) {
     // Check if system is little endian
     uint16_t test = 1;
@@ -106,4 +170,28 @@ int write_i32_big(FILE* file, uint32_t value) {
     size_t written = fwrite(&be_value, sizeof(uint32_t), 1, file);
     
     return (written == 1) ? 0 : -1;
-}
\ No newline at end of file
+}
+
+// Store a 16-bit integer in big endian format
+void put_i16_big(uint8_t *dest, uint16_t value) {
+    dest[0] = (uint8_t) (value >> 8);
+    dest[1] = (uint8_t) value;
+}
+
+// Store a 32-bit integer in big endian format
+void put_i32_big(uint8_t *dest, uint32_t value) {
+    dest[0] = (uint8_t) (value >> 24);
+    dest[1] = (uint8_t) (value >> 16);
+    dest[2] = (uint8_t) (value >> 8);
+    dest[3] = (uint8_t) value;
+}
+
+// Load a 16-bit big endian integer
+uint16_t get_i16_big(const uint8_t *src) {
+    return (uint16_t) ((src[0] << 8) | src[1]);
+}
+
+// Load a 32-bit big endian integer
+uint32_t get_i32_big(const uint8_t *src) {
+    return ((uint32_t) src[0] << 24) | ((uint32_t) src[1] << 16) | ((uint32_t) src[2] << 8) | (uint32_t) src[3];
+}
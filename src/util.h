@@ -2,16 +2,33 @@
 #define G1_UTIL_H
 
 
+#include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "arena.h"
+
+
+// Path that stands for stdin or stdout.
+#define STDIO_PATH "-"
 
 
 // Based on https://stackoverflow.com/a/3464656
 // Reads data from `file_path` into `output_buffer` and stores the length in `length`.
-int read_file_bytes(char **output_buffer, size_t *length, const char *file_path);
+// The buffer is allocated from `arena`.
+int read_file_bytes(char **output_buffer, size_t *length, const char *file_path, Arena *arena);
+
+// Reads `stream` until EOF into `output_buffer` and stores the length in `length`.
+// The buffer is allocated from `arena`.
+int read_stream_bytes(char **output_buffer, size_t *length, FILE *stream, Arena *arena);
 
 bool file_exists(char* path);
 
+// Open `path` for binary writing, or return stdout if it is `STDIO_PATH`.
+FILE* open_output_stream(const char *path);
+
+// Close a stream returned by `open_output_stream`.
+int close_output_stream(FILE *stream);
+
 bool safecat(char* dest, char* src, int size);
 
 // Write a 16 bit integer to `file` in big endian format.
@@ -21,4 +38,17 @@ int write_i16_big(FILE* file, uint16_t value);
 int write_i32_big(FILE* file, uint32_t value);
 
 
+// Store a 16 bit integer at `dest` in big endian format.
+void put_i16_big(uint8_t *dest, uint16_t value);
+
+// Store a 32 bit integer at `dest` in big endian format.
+void put_i32_big(uint8_t *dest, uint32_t value);
+
+// Load a 16 bit big endian integer from `src`.
+uint16_t get_i16_big(const uint8_t *src);
+
+// Load a 32 bit big endian integer from `src`.
+uint32_t get_i32_big(const uint8_t *src);
+
+
 #endif
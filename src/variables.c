@@ -0,0 +1,341 @@
+#include <string.h>
+#include "variables.h"
+
+#define WORD_BITS 64
+#define NO_SUCCESSOR -1
+
+
+typedef struct {
+    size_t amount_instructions, amount_variables, words;
+
+    // Text the instruction tokens point into
+    const char *source;
+
+    // Successors of every instruction, `amount_instructions` stands for leaving the program
+    int32_t (*successors)[2];
+
+    // Variable index of every argument, or -1
+    int32_t (*argument_variables)[MAX_ARGUMENTS];
+
+    // Variables live on entry to every instruction, and on leaving the program
+    uint64_t *live_in, *exit_live;
+} Liveness;
+
+
+static inline void set_bit(uint64_t *set, size_t bit) {
+    set[bit / WORD_BITS] |= (uint64_t) 1 << (bit % WORD_BITS);
+}
+
+
+static inline bool get_bit(const uint64_t *set, size_t bit) {
+    return (set[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1;
+}
+
+
+static int32_t get_variable_index(const char *source, const Token *token, const LabelMap *variables) {
+    int32_t index;
+    if (!is_variable_token(source, token)) {
+        return -1;
+    }
+    if (get_label_map_value(&index, variables, get_token_text(source, token) + 1, token->length - 1) != 0) {
+        return -1;
+    }
+    return index;
+}
+
+
+// Returns whether `token` has a value known at assembly time, and stores it in `value`.
+static bool get_literal_value(int32_t *value, const char *source, const Token *token, const LabelMap *labels) {
+    const char *token_value = get_token_text(source, token);
+    if (token->type == INTEGER) {
+        *value = (int32_t) strtol(token_value, NULL, 10);
+        return true;
+    }
+    if (token->type == NAME) {
+        return get_label_map_value(value, labels, token_value, token->length) == 0;
+    }
+    return false;
+}
+
+
+// Fill in the successors of every instruction. Returns -1 if a jump target is not known statically.
+static int find_successors(Liveness *liveness, const InstructionList *instructions, const LabelMap *labels) {
+    int32_t exit = (int32_t) instructions->size;
+    for (size_t i = 0; i < instructions->size; i++) {
+        const Instruction *ins = get_instruction_list_value(instructions, i);
+        int32_t *successors = liveness->successors[i];
+        successors[0] = (int32_t) i + 1;
+        successors[1] = NO_SUCCESSOR;
+        if (ins->opcode != JMP_OP) {
+            continue;
+        }
+
+        int32_t target, condition;
+        if (!get_literal_value(&target, liveness->source, &ins->arguments[0], labels)) {
+            return -1;
+        }
+        if (target < 0 || target > exit) {
+            target = exit;
+        }
+
+        if (get_literal_value(&condition, liveness->source, &ins->arguments[1], labels)) {
+            if (condition != 0) {
+                successors[0] = target;
+            }
+        }
+        else {
+            successors[1] = target;
+        }
+    }
+    return 0;
+}
+
+
+// Store the union of the live sets of instruction `index`'s successors in `out`.
+static void get_live_out(uint64_t *out, const Liveness *liveness, size_t index) {
+    memset(out, 0, liveness->words * sizeof(uint64_t));
+    for (size_t s = 0; s < 2; s++) {
+        int32_t successor = liveness->successors[index][s];
+        if (successor == NO_SUCCESSOR) {
+            continue;
+        }
+        const uint64_t *successor_live = (size_t) successor >= liveness->amount_instructions
+            ? liveness->exit_live
+            : &liveness->live_in[successor * liveness->words];
+        for (size_t w = 0; w < liveness->words; w++) {
+            out[w] |= successor_live[w];
+        }
+    }
+}
+
+
+static void compute_liveness(Liveness *liveness, const InstructionList *instructions, int32_t tick_label) {
+    size_t words = liveness->words;
+    uint64_t out[words], uses[words], defs[words];
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = instructions->size; i-- > 0;) {
+            const Instruction *ins = get_instruction_list_value(instructions, i);
+
+            get_live_out(out, liveness, i);
+
+            memset(uses, 0, sizeof(uses));
+            memset(defs, 0, sizeof(defs));
+            for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+                int32_t variable = liveness->argument_variables[i][j];
+                if (variable == -1) {
+                    continue;
+                }
+                if (j == 0 && WRITES_FIRST_ARGUMENT[ins->opcode]) {
+                    set_bit(defs, variable);
+                }
+                else {
+                    set_bit(uses, variable);
+                }
+            }
+
+            uint64_t *live_in = &liveness->live_in[i * words];
+            for (size_t w = 0; w < words; w++) {
+                uint64_t value = uses[w] | (out[w] & ~defs[w]);
+                if (value != live_in[w]) {
+                    live_in[w] = value;
+                    changed = true;
+                }
+            }
+        }
+
+        // The VM runs tick again after leaving the program, and memory persists between ticks
+        if (tick_label >= 0 && (size_t) tick_label < instructions->size) {
+            const uint64_t *tick_live = &liveness->live_in[tick_label * words];
+            for (size_t w = 0; w < words; w++) {
+                if ((liveness->exit_live[w] | tick_live[w]) != liveness->exit_live[w]) {
+                    liveness->exit_live[w] |= tick_live[w];
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+
+// Mark every pair of variables that may hold a value at the same time.
+static void build_interference(uint64_t *interference, const Liveness *liveness, const InstructionList *instructions, const LabelMap *labels) {
+    size_t words = liveness->words;
+    size_t amount_variables = liveness->amount_variables;
+
+    // Variables live on entry may rely on zeroed memory, so they never share an address
+    uint64_t pinned[words];
+    memset(pinned, 0, sizeof(pinned));
+    const char *entry_labels[2] = {"start", "tick"};
+    for (size_t e = 0; e < 2; e++) {
+        int32_t entry;
+        if (get_label_map_value(&entry, labels, entry_labels[e], strlen(entry_labels[e])) == 0 && (size_t) entry < instructions->size) {
+            for (size_t w = 0; w < words; w++) {
+                pinned[w] |= liveness->live_in[entry * words + w];
+            }
+        }
+    }
+    for (size_t v = 0; v < amount_variables; v++) {
+        if (get_bit(pinned, v)) {
+            for (size_t u = 0; u < amount_variables; u++) {
+                set_bit(&interference[v * words], u);
+                set_bit(&interference[u * words], v);
+            }
+        }
+    }
+
+    // A variable interferes with everything live after each write to it
+    uint64_t out[words];
+    for (size_t i = 0; i < instructions->size; i++) {
+        const Instruction *ins = get_instruction_list_value(instructions, i);
+        int32_t defined = liveness->argument_variables[i][0];
+        if (!WRITES_FIRST_ARGUMENT[ins->opcode] || defined == -1) {
+            continue;
+        }
+
+        get_live_out(out, liveness, i);
+
+        for (size_t v = 0; v < amount_variables; v++) {
+            if (get_bit(out, v) && (int32_t) v != defined) {
+                set_bit(&interference[defined * words], v);
+                set_bit(&interference[v * words], defined);
+            }
+        }
+    }
+}
+
+
+// Greedily give every variable the lowest slot none of its neighbors use. `taken` has room for
+// one entry per variable and one more. Returns the amount of slots.
+static size_t assign_slots(int32_t *slots, bool *taken, const uint64_t *interference, size_t amount_variables, size_t words) {
+    size_t amount_slots = 0;
+    for (size_t v = 0; v < amount_variables; v++) {
+        memset(taken, 0, (amount_variables + 1) * sizeof(bool));
+        for (size_t u = 0; u < v; u++) {
+            if (get_bit(&interference[v * words], u)) {
+                taken[slots[u]] = true;
+            }
+        }
+        size_t slot = 0;
+        while (taken[slot]) {
+            slot++;
+        }
+        slots[v] = (int32_t) slot;
+        if (slot + 1 > amount_slots) {
+            amount_slots = slot + 1;
+        }
+    }
+    return amount_slots;
+}
+
+
+// Find the highest numeric address and whether the program uses `movp`. Also fills
+// `argument_variables` unless it is NULL. Returns the highest address, or -1 if there is none.
+static int32_t scan_addresses(
+        VariableAllocation *allocation, int32_t (*argument_variables)[MAX_ARGUMENTS],
+        const InstructionList *instructions, const LabelMap *variables, const char *source
+    ) {
+    int32_t highest_address = -1;
+    allocation->has_indirect_access = false;
+    for (size_t i = 0; i < instructions->size; i++) {
+        const Instruction *ins = get_instruction_list_value(instructions, i);
+        if (ins->opcode == MOVP_OP) {
+            allocation->has_indirect_access = true;
+        }
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[ins->opcode]; j++) {
+            const Token *token = &ins->arguments[j];
+            if (argument_variables != NULL) {
+                argument_variables[i][j] = get_variable_index(source, token, variables);
+            }
+            if (token->type == ADDRESS && !is_variable_token(source, token)) {
+                int32_t address = (int32_t) strtol(get_token_text(source, token) + 1, NULL, 10);
+                if (address > highest_address) {
+                    highest_address = address;
+                }
+            }
+        }
+    }
+    return highest_address;
+}
+
+
+// Returns 0, or -2 if the variables do not fit above the highest numeric address.
+static int assign_addresses(
+        VariableAllocation *allocation, LabelMap *variables, Liveness *liveness,
+        uint64_t *interference, int32_t *slots, bool *taken,
+        const InstructionList *instructions, const LabelMap *labels
+    ) {
+    size_t amount_variables = liveness->amount_variables;
+    int32_t highest_address = scan_addresses(allocation, liveness->argument_variables, instructions, variables, liveness->source);
+
+    // Only share addresses when every path through the program is known
+    allocation->shared = amount_variables > 0
+        && !allocation->has_indirect_access
+        && find_successors(liveness, instructions, labels) == 0;
+
+    if (allocation->shared) {
+        int32_t tick_label = -1;
+        get_label_map_value(&tick_label, labels, "tick", 4);
+        compute_liveness(liveness, instructions, tick_label);
+        build_interference(interference, liveness, instructions, labels);
+        allocation->amount_slots = assign_slots(slots, taken, interference, amount_variables, liveness->words);
+    }
+    else {
+        for (size_t v = 0; v < amount_variables; v++) {
+            slots[v] = (int32_t) v;
+        }
+        allocation->amount_slots = amount_variables;
+    }
+
+    // #memory is a signed 32 bit value and has to cover every variable
+    allocation->memory_used = (int64_t) highest_address + 1 + (int64_t) allocation->amount_slots;
+    if (allocation->amount_slots > 0 && allocation->memory_used > INT32_MAX) {
+        return -2;
+    }
+    // Without variables nothing is placed, and the address after the highest one may not exist
+    allocation->first_address = allocation->amount_slots > 0 ? highest_address + 1 : 0;
+
+    // Replace declaration indices with addresses
+    for (size_t i = 0; i < variables->capacity; i++) {
+        LabelMapNode *node = &variables->data[i];
+        if (node->key != NULL) {
+            node->value = allocation->first_address + slots[node->value];
+        }
+    }
+    return 0;
+}
+
+
+int allocate_variables(
+        VariableAllocation *allocation, LabelMap *variables,
+        const InstructionList *instructions, const LabelMap *labels, const char *source, Arena *arena
+    ) {
+    size_t amount_variables = variables->size;
+    size_t words = amount_variables / WORD_BITS + 1;
+
+    // Without variables only the addresses the program touches are needed
+    if (amount_variables == 0) {
+        int32_t highest_address = scan_addresses(allocation, NULL, instructions, variables, source);
+        allocation->amount_slots = 0;
+        allocation->first_address = 0;
+        allocation->memory_used = (int64_t) highest_address + 1;
+        allocation->shared = false;
+        return 0;
+    }
+
+    Liveness liveness = {instructions->size, amount_variables, words, source, NULL, NULL, NULL, NULL};
+    liveness.successors = arena_alloc(arena, (instructions->size + 1) * sizeof(*liveness.successors));
+    liveness.argument_variables = arena_alloc(arena, (instructions->size + 1) * sizeof(*liveness.argument_variables));
+    liveness.live_in = arena_calloc(arena, (instructions->size + 1) * words, sizeof(uint64_t));
+    liveness.exit_live = arena_calloc(arena, words, sizeof(uint64_t));
+    uint64_t *interference = arena_calloc(arena, amount_variables * words + 1, sizeof(uint64_t));
+    int32_t *slots = arena_alloc(arena, (amount_variables + 1) * sizeof(int32_t));
+    bool *taken = arena_alloc(arena, (amount_variables + 1) * sizeof(bool));
+
+    if (!liveness.successors || !liveness.argument_variables || !liveness.live_in || !liveness.exit_live || !interference || !slots || !taken) {
+        return -1;
+    }
+    return assign_addresses(allocation, variables, &liveness, interference, slots, taken, instructions, labels);
+}
@@ -0,0 +1,42 @@
+#ifndef G1_VARIABLES_H
+#define G1_VARIABLES_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "instruction.h"
+#include "arena.h"
+
+
+typedef struct {
+    // Amount of addresses given to variables, starting at `first_address`
+    size_t amount_slots;
+    int32_t first_address;
+
+    // One past the highest address any argument touches. Can be 2^31 when the program uses
+    // the highest address, so it does not fit the 32 bit addresses themselves.
+    int64_t memory_used;
+
+    // The program uses `movp`, so it may touch addresses that are not known statically
+    bool has_indirect_access;
+
+    // Variables with disjoint lifetimes were allowed to share addresses
+    bool shared;
+} VariableAllocation;
+
+
+// Give every variable in `variables` an address above the highest numeric address in the program.
+// On input each value is the variable's declaration index; on success it is replaced with its address.
+// Variables that are never live at the same time share an address, unless the program jumps to
+// computed targets or uses `movp`, in which case every variable gets its own address.
+// `source` is the text the instruction tokens point into. Scratch memory comes from `arena`.
+// Returns 0, -1 if allocating scratch memory failed, or -2 if there is no room for the variables
+// above the highest numeric address.
+int allocate_variables(
+    VariableAllocation *allocation, LabelMap *variables,
+    const InstructionList *instructions, const LabelMap *labels, const char *source, Arena *arena
+);
+
+
+#endif
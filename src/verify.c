@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include "instruction.h"
+#include "verify.h"
+
+
+static int fail(VerifyResult *result, VerifyError error, size_t index, uint8_t argument) {
+    result->error = error;
+    result->failed_index = index;
+    result->failed_argument = argument;
+    return -1;
+}
+
+
+int verify_image_code(VerifyResult *result, const uint8_t *code, size_t code_size, const ImageHeader *header) {
+    result->flags = 0;
+    result->has_indirect_access = false;
+    result->has_computed_jumps = false;
+    result->error = VERIFY_OK;
+
+    int32_t memory = header->meta_vars[0];
+    int64_t amount_instructions = header->instruction_count;
+
+    size_t offset = 0;
+    uint8_t opcode;
+    Argument values[MAX_ARGUMENTS];
+    for (size_t i = 0; i < header->instruction_count; i++) {
+        size_t size = decode_instruction(&opcode, values, code + offset, code_size - offset);
+        if (size == 0) {
+            return fail(result, VERIFY_BAD_CODE, i, 0);
+        }
+        offset += size;
+
+        for (uint8_t j = 0; j < ARGUMENT_COUNTS[opcode]; j++) {
+            if (values[j].type == ADDRESS_ARG && (values[j].value < 0 || values[j].value >= memory)) {
+                return fail(result, VERIFY_BAD_ADDRESS, i, j);
+            }
+        }
+
+        if (opcode == MOVP_OP) {
+            result->has_indirect_access = true;
+        }
+        else if (opcode == JMP_OP) {
+            const Argument *target = &values[0], *condition = &values[1];
+            bool is_taken = condition->type == ADDRESS_ARG || condition->value != 0;
+            if (target->type == ADDRESS_ARG) {
+                result->has_computed_jumps = true;
+            }
+            else if (is_taken && (target->value < 0 || target->value > amount_instructions)) {
+                return fail(result, VERIFY_BAD_JUMP, i, 0);
+            }
+        }
+    }
+    if (offset != code_size) {
+        return fail(result, VERIFY_BAD_CODE, header->instruction_count, 0);
+    }
+
+    if (!result->has_indirect_access) {
+        result->flags |= IMAGE_MEMORY_VERIFIED;
+    }
+    if (!result->has_computed_jumps) {
+        result->flags |= IMAGE_JUMPS_VERIFIED;
+    }
+    return 0;
+}
+
+
+const char* get_verify_error_message(VerifyError error) {
+    switch (error) {
+        case VERIFY_BAD_ADDRESS:
+            return "Address is outside of #memory.";
+        case VERIFY_BAD_JUMP:
+            return "Jump target is outside of the program.";
+        case VERIFY_BAD_CODE:
+            return "Code does not decode into the instruction count.";
+        default:
+            return "Verified.";
+    }
+}
+
+
+void warn_unverified(const VerifyResult *result, const char *name) {
+    if (result->has_indirect_access) {
+        fprintf(stderr, "\x1b[33mWARNING (%s): Memory accesses are not verified, the program uses movp.\n", name);
+    }
+    if (result->has_computed_jumps) {
+        fprintf(stderr, "\x1b[33mWARNING (%s): Jumps are not verified, the program jumps to computed targets.\n", name);
+    }
+}
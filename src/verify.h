@@ -0,0 +1,46 @@
+#ifndef G1_VERIFY_H
+#define G1_VERIFY_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "image.h"
+
+
+typedef enum {
+    VERIFY_OK,
+    VERIFY_BAD_ADDRESS,
+    VERIFY_BAD_JUMP,
+    VERIFY_BAD_CODE
+} VerifyError;
+
+
+typedef struct {
+    // IMAGE_*_VERIFIED flags for the checks the whole program passed
+    uint8_t flags;
+
+    // Reasons a flag could not be set
+    bool has_indirect_access, has_computed_jumps;
+
+    // The instruction and argument that broke a bound, if `error` is not VERIFY_OK
+    VerifyError error;
+    size_t failed_index;
+    uint8_t failed_argument;
+} VerifyResult;
+
+
+// Check the `code_size` bytes of encoded instructions at `code` against `header`. Every address
+// must be below #memory and every literal jump target must lie in [0, instruction count].
+// Addresses read through `movp` and jump targets read from memory can not be checked, so they
+// only leave the matching flag unset. Returns 0, or -1 if an instruction breaks a bound.
+int verify_image_code(VerifyResult *result, const uint8_t *code, size_t code_size, const ImageHeader *header);
+
+// Returns a diagnostic describing `error`.
+const char* get_verify_error_message(VerifyError error);
+
+// Warn about every check `result` could not complete for the program `name`.
+void warn_unverified(const VerifyResult *result, const char *name);
+
+
+#endif
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Assemble every source in the subdirectories of tests with -v plus the flags of its
+# "; flags: " line, and check that the statistics printed to stderr contain each
+# "; expect: " line of the source.
+#
+#   sh tests/run.sh [ASSEMBLER]
+
+assembler=${1:-build/g1a}
+directory=$(dirname "$0")
+failed=0
+
+for source in "$directory"/*/*.g1s; do
+    flags=$(sed -n 's/^; flags: //p' "$source")
+    # $flags is left unquoted so that several flags split into separate arguments
+    if ! output=$("$assembler" "$source" /dev/null -v $flags 2>&1); then
+        echo "FAIL $source: assembling failed"
+        echo "$output"
+        failed=1
+        continue
+    fi
+
+    while IFS= read -r expected; do
+        case "$output" in
+            *"$expected"*) ;;
+            *)
+                echo "FAIL $source: expected \"$expected\""
+                echo "$output"
+                failed=1
+                ;;
+        esac
+    done <<END
+$(sed -n 's/^; expect: //p' "$source")
+END
+done
+
+if [ "$failed" -eq 0 ]; then
+    echo "All tests passed."
+fi
+exit "$failed"